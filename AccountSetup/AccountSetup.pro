@@ -19,27 +19,66 @@ QT += \
 # -----------------------------------------------------------------------------
 PKGCONFIG += \
     accounts-qt
+include(libaccounts-glib.pri)
+
+# clock_gettime(), for tracing
+LIBS += -lrt
 
 # -----------------------------------------------------------------------------
 # input
 # -----------------------------------------------------------------------------
 HEADERS += \
+    plugin-channel.h \
+    plugin-index.h \
+    plugin-launcher.h \
+    plugin-launch.h \
+    plugin-metrics.h \
+    plugin-output.h \
+    plugin-prefetch.h \
+    plugin-reaper.h \
+    plugin-resolver.h \
+    plugin-scheduler.h \
+    plugin-trace.h \
+    provider-plugin-batch.h \
+    provider-plugin-batch-priv.h \
+    provider-plugin-interface.h \
     provider-plugin-process.h \
     provider-plugin-process-priv.h \
     provider-plugin-proxy.h \
-    provider-plugin-proxy-priv.h
+    provider-plugin-proxy-priv.h \
+    provider-plugin-session.h \
+    provider-plugin-session-priv.h
 
 SOURCES += \
+    plugin-channel.cpp \
+    plugin-index.cpp \
+    plugin-launcher.cpp \
+    plugin-launch.cpp \
+    plugin-metrics.cpp \
+    plugin-output.cpp \
+    plugin-prefetch.cpp \
+    plugin-reaper.cpp \
+    plugin-resolver.cpp \
+    plugin-scheduler.cpp \
+    plugin-trace.cpp \
+    provider-plugin-batch.cpp \
     provider-plugin-process.cpp \
-    provider-plugin-proxy.cpp
+    provider-plugin-proxy.cpp \
+    provider-plugin-session.cpp
 
 # headers are the files which will be installed with "make install"
 headers.files += \
     common.h \
+    ProviderPluginBatch \
+    provider-plugin-batch.h \
+    ProviderPluginInterface \
+    provider-plugin-interface.h \
     ProviderPluginProcess \
     provider-plugin-process.h \
     ProviderPluginProxy \
     provider-plugin-proxy.h \
+    ProviderPluginSession \
+    provider-plugin-session.h \
     types.h
 
 # -----------------------------------------------------------------------------
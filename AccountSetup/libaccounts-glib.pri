@@ -0,0 +1,15 @@
+#-----------------------------------------------------------------------------
+# PluginResolver reads the provider files through libaccounts-glib, and
+# needs to know where libaccounts looks for them.
+#-----------------------------------------------------------------------------
+
+PKGCONFIG += \
+    libaccounts-glib
+
+PROVIDER_FILES_DIR = \
+    $$system(pkg-config --variable=providerfilesdir libaccounts-glib)
+!isEmpty(PROVIDER_FILES_DIR) {
+    DEFINES += PROVIDER_FILES_DIR=\\\"$$PROVIDER_FILES_DIR\\\"
+}
+
+# End of File
@@ -0,0 +1,390 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "plugin-channel.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QTime>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace AccountSetup;
+
+static const int headerSize = 4;
+/* version and type */
+static const int typeSize = 2;
+/* upper limit to the message size, to reject garbage */
+static const quint32 maxMessageSize = 256 * 1024 * 1024;
+
+/* older C libraries have the system call, but not the flags */
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#define MFD_ALLOW_SEALING 0x0002U
+#endif
+
+static quint32 readLength(const char *data)
+{
+    const uchar *bytes = reinterpret_cast<const uchar *>(data);
+    return (quint32(bytes[0]) << 24) | (quint32(bytes[1]) << 16) |
+        (quint32(bytes[2]) << 8) | quint32(bytes[3]);
+}
+
+PluginChannel::PluginChannel(QLocalSocket *socket, QObject *parent):
+    QObject(parent),
+    m_socket(socket),
+    m_timeout(0),
+    m_descriptorSocket(-1)
+{
+    m_socket->setParent(this);
+    m_timer.setSingleShot(true);
+
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(onDisconnected()));
+    connect(&m_timer, SIGNAL(timeout()), this, SIGNAL(timedOut()));
+}
+
+PluginChannel::~PluginChannel()
+{
+    if (m_descriptorSocket >= 0)
+        ::close(m_descriptorSocket);
+}
+
+void PluginChannel::setTimeout(int msecs)
+{
+    m_timeout = msecs;
+    if (m_timeout <= 0)
+        m_timer.stop();
+}
+
+bool PluginChannel::sendMessage(MessageType type, const QByteArray &payload)
+{
+    char header[headerSize + typeSize];
+    quint32 length = typeSize + payload.size();
+    header[0] = char(length >> 24);
+    header[1] = char(length >> 16);
+    header[2] = char(length >> 8);
+    header[3] = char(length);
+    header[4] = char(ProtocolVersion);
+    header[5] = char(type);
+
+    return m_socket->write(header, sizeof(header)) == sizeof(header) &&
+        m_socket->write(payload) == payload.size();
+}
+
+bool PluginChannel::sendVariant(MessageType type, const QVariant &value)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << value;
+    return sendMessage(type, payload);
+}
+
+QVariant PluginChannel::toVariant(const QByteArray &payload)
+{
+    QVariant value;
+    QDataStream stream(payload);
+    stream >> value;
+    return value;
+}
+
+bool PluginChannel::waitForBytesWritten(int msecs)
+{
+    QTime time;
+    time.start();
+
+    /* a large message needs several rounds, as the reader drains it */
+    while (m_socket->bytesToWrite() > 0) {
+        int remaining = msecs - time.elapsed();
+        if (remaining <= 0 || !m_socket->waitForBytesWritten(remaining))
+            return false;
+    }
+    return true;
+}
+
+void PluginChannel::setDescriptorSocket(int fd)
+{
+    if (m_descriptorSocket >= 0)
+        ::close(m_descriptorSocket);
+    m_descriptorSocket = fd;
+}
+
+bool PluginChannel::sendDescriptor(int fd)
+{
+    if (m_descriptorSocket < 0)
+        return false;
+
+    /* at least one byte of real data must go with the descriptor */
+    char byte = 0;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = sizeof(byte);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    ssize_t sent;
+    do {
+        sent = ::sendmsg(m_descriptorSocket, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+
+    return sent == 1;
+}
+
+int PluginChannel::receiveDescriptor()
+{
+    if (m_descriptorSocket < 0)
+        return -1;
+
+    char byte;
+    struct iovec iov;
+    iov.iov_base = &byte;
+    iov.iov_len = sizeof(byte);
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = ::recvmsg(m_descriptorSocket, &msg,
+                             MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+    } while (received < 0 && errno == EINTR);
+    if (received != 1)
+        return -1;
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg == 0 || cmsg->cmsg_level != SOL_SOCKET ||
+        cmsg->cmsg_type != SCM_RIGHTS ||
+        cmsg->cmsg_len != CMSG_LEN(sizeof(int)))
+        return -1;
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+bool PluginChannel::createSocketPair(int fds[2])
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+        return false;
+
+    /* Neither end must leak into other children; the plugin's end is made
+     * inheritable only in its own child, by the launcher. */
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+}
+
+PluginChannel *PluginChannel::fromDescriptors(int fd, int descriptorFd)
+{
+    QLocalSocket *socket = new QLocalSocket;
+    if (!socket->setSocketDescriptor(fd)) {
+        qWarning() << "Cannot open the plugin channel";
+        delete socket;
+        ::close(fd);
+        if (descriptorFd >= 0)
+            ::close(descriptorFd);
+        return 0;
+    }
+
+    PluginChannel *channel = new PluginChannel(socket);
+    if (descriptorFd >= 0)
+        channel->setDescriptorSocket(descriptorFd);
+    return channel;
+}
+
+int PluginChannel::createSharedBuffer(const QByteArray &data)
+{
+#if defined(SYS_memfd_create) && defined(F_ADD_SEALS)
+    int fd = ::syscall(SYS_memfd_create, "accountsetup-result",
+                       MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+        return -1;
+
+    const char *bytes = data.constData();
+    qint64 remaining = data.size();
+    while (remaining > 0) {
+        ssize_t written = ::write(fd, bytes, remaining);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0) {
+            ::close(fd);
+            return -1;
+        }
+        bytes += written;
+        remaining -= written;
+    }
+
+    /* the receiver maps it: it must not change under its feet */
+    if (::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                F_SEAL_WRITE | F_SEAL_SEAL) < 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+#else
+    Q_UNUSED(data);
+    return -1;
+#endif
+}
+
+void PluginChannel::onReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+
+    int offset = 0;
+    while (m_buffer.size() - offset >= headerSize) {
+        quint32 length = readLength(m_buffer.constData() + offset);
+        if (length < quint32(typeSize) || length > maxMessageSize) {
+            qWarning() << "Invalid message length" << length;
+            m_buffer.clear();
+            m_socket->abort();
+            return;
+        }
+
+        if (quint32(m_buffer.size() - offset - headerSize) < length) {
+            /* avoid reallocating over and over while a large message is
+             * coming */
+            m_buffer.reserve(headerSize + length);
+            break;
+        }
+
+        const char *message = m_buffer.constData() + offset + headerSize;
+        quint8 version = message[0];
+        quint8 type = message[1];
+        QByteArray payload = m_buffer.mid(offset + headerSize + typeSize,
+                                          length - typeSize);
+        offset += headerSize + length;
+
+        if (version != ProtocolVersion) {
+            qWarning() << "Unsupported protocol version" << version;
+            continue;
+        }
+        emit messageReceived(type, payload);
+    }
+
+    if (offset > 0)
+        m_buffer.remove(0, offset);
+
+    /* An idle channel is fine, but once a message has started arriving, it
+     * must keep coming; any progress restarts the timeout. */
+    if (m_timeout > 0 && !m_buffer.isEmpty())
+        m_timer.start(m_timeout);
+    else
+        m_timer.stop();
+}
+
+void PluginChannel::onDisconnected()
+{
+    m_timer.stop();
+
+    /* the last bytes might come together with the disconnection */
+    if (m_socket->bytesAvailable() > 0)
+        onReadyRead();
+
+    if (!m_buffer.isEmpty())
+        qWarning() << "Channel closed with an incomplete message";
+
+    emit disconnected();
+}
+
+PluginChannelProcess::PluginChannelProcess(QObject *parent):
+    QProcess(parent)
+{
+    m_childFds[0] = -1;
+    m_childFds[1] = -1;
+}
+
+PluginChannelProcess::~PluginChannelProcess()
+{
+}
+
+PluginChannel *
+PluginChannelProcess::startWithChannel(const QString &program,
+                                       const QStringList &arguments)
+{
+    int fds[2];
+    if (!PluginChannel::createSocketPair(fds)) {
+        qWarning() << "Cannot create the plugin channel";
+        start(program, arguments);
+        return 0;
+    }
+
+    QStringList channelArguments;
+    channelArguments << QLatin1String("--channelFd") <<
+        QString::number(fds[1]);
+    m_childFds[0] = fds[1];
+
+    /* without it, results are sent inline */
+    int descriptorFds[2] = { -1, -1 };
+    if (PluginChannel::createSocketPair(descriptorFds)) {
+        channelArguments << QLatin1String("--descriptorFd") <<
+            QString::number(descriptorFds[1]);
+        m_childFds[1] = descriptorFds[1];
+    }
+
+    start(program, arguments + channelArguments);
+
+    /* the child has its own copies by now: the caller gets EOF when it
+     * exits */
+    for (int i = 0; i < 2; i++) {
+        if (m_childFds[i] >= 0)
+            ::close(m_childFds[i]);
+        m_childFds[i] = -1;
+    }
+
+    return PluginChannel::fromDescriptors(fds[0], descriptorFds[0]);
+}
+
+void PluginChannelProcess::setupChildProcess()
+{
+    /* runs in the child, between fork() and exec() */
+    for (int i = 0; i < 2; i++) {
+        if (m_childFds[i] >= 0)
+            ::fcntl(m_childFds[i], F_SETFD, 0);
+    }
+}
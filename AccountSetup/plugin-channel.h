@@ -0,0 +1,162 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTSETUP_PLUGIN_CHANNEL_H
+#define ACCOUNTSETUP_PLUGIN_CHANNEL_H
+
+//Qt
+#include <QByteArray>
+#include <QLocalSocket>
+#include <QObject>
+#include <QProcess>
+#include <QTimer>
+#include <QVariant>
+
+namespace AccountSetup {
+
+/*
+ * Bidirectional message channel between the ProviderPluginProxy and a plugin
+ * process. Every message is framed as:
+ *
+ *   quint32 length (big endian) of what follows
+ *   quint8  protocol version
+ *   quint8  message type
+ *   payload
+ *
+ * Incoming data is buffered as it arrives, and messageReceived() is emitted
+ * for each complete message, without ever blocking the event loop. Messages
+ * with a different protocol version are dropped.
+ */
+class PluginChannel: public QObject
+{
+    Q_OBJECT
+
+public:
+    enum { ProtocolVersion = 1 };
+
+    enum MessageType {
+        /* from the plugin to the caller */
+        Result = 1,
+        Progress,
+        PartialResult,
+        /* the result is in a shared buffer passed as a descriptor */
+        SharedResult,
+        /* timestamps of the plugin's startup phases */
+        Trace,
+        /* after the result, in server mode: ready for another launch */
+        Idle,
+        /* the account has been stored, before the plugin quits */
+        AccountReady,
+        /* from the caller to the plugin */
+        Cancel = 64,
+        Focus,
+        Parameters,
+        /* arguments for a plugin started in standby */
+        Launch,
+    };
+
+    /* Takes ownership of the socket */
+    PluginChannel(QLocalSocket *socket, QObject *parent = 0);
+    ~PluginChannel();
+
+    QLocalSocket *socket() const { return m_socket; }
+
+    /* Time after which the channel gives up waiting for the rest of a
+     * partially received message, in milliseconds; 0 disables the
+     * timeout. */
+    void setTimeout(int msecs);
+
+    bool sendMessage(MessageType type,
+                     const QByteArray &payload = QByteArray());
+    bool sendVariant(MessageType type, const QVariant &value);
+    static QVariant toVariant(const QByteArray &payload);
+
+    /* Blocking; only to be used where there is no event loop to return to */
+    bool waitForBytesWritten(int msecs);
+
+    /* File descriptors travel on a separate socket, since the QLocalSocket
+     * would drop them while reading. The channel takes ownership of it. */
+    void setDescriptorSocket(int fd);
+    bool hasDescriptorSocket() const { return m_descriptorSocket >= 0; }
+    bool sendDescriptor(int fd);
+    /* Doesn't block; returns -1 if no descriptor has arrived */
+    int receiveDescriptor();
+
+    /* Returns a sealed, read-only memory file holding the data, or -1 if
+     * the system doesn't support them */
+    static int createSharedBuffer(const QByteArray &data);
+
+    /* An anonymous socket pair, with both ends closed on exec */
+    static bool createSocketPair(int fds[2]);
+    /* Wraps the caller's ends of the socket pairs; descriptorFd can be -1.
+     * On failure, both are closed and 0 is returned. */
+    static PluginChannel *fromDescriptors(int fd, int descriptorFd);
+
+Q_SIGNALS:
+    void messageReceived(int type, const QByteArray &payload);
+    void disconnected();
+    void timedOut();
+
+private Q_SLOTS:
+    void onReadyRead();
+    void onDisconnected();
+
+private:
+    QLocalSocket *m_socket;
+    QByteArray m_buffer;
+    QTimer m_timer;
+    int m_timeout;
+    int m_descriptorSocket;
+};
+
+/*
+ * A QProcess connected to the caller through an anonymous socket pair: the
+ * child inherits its end of the pair, and receives its number with the
+ * --channelFd argument. There's no name to look up, and the channel is
+ * usable before the child has even started. A second pair, passed with
+ * --descriptorFd, carries file descriptors.
+ */
+class PluginChannelProcess: public QProcess
+{
+    Q_OBJECT
+
+public:
+    PluginChannelProcess(QObject *parent = 0);
+    ~PluginChannelProcess();
+
+    /* Starts the process and returns the caller's end of the channel, or 0
+     * if the channel cannot be set up; the process is started in any
+     * case. */
+    PluginChannel *startWithChannel(const QString &program,
+                                    const QStringList &arguments);
+
+protected:
+    void setupChildProcess();
+
+private:
+    int m_childFds[2];
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_CHANNEL_H
@@ -0,0 +1,394 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "plugin-index.h"
+
+#include <Accounts/Manager>
+
+#include <QByteArray>
+#include <QDebug>
+#include <QFileInfo>
+#include <QMap>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+/*
+ * File layout; all the offsets are from the beginning of the file and the
+ * strings are UTF-8 encoded, not NUL-terminated. The entries are sorted by
+ * provider ID.
+ *
+ *   IndexHeader
+ *   IndexDirectory[directoryCount]
+ *   IndexEntry[entryCount]
+ *   string data
+ */
+static const char indexMagic[4] = { 'A', 'S', 'P', 'I' };
+static const quint32 indexVersion = 2;
+
+struct IndexHeader
+{
+    char magic[4];
+    quint32 version;
+    quint32 directoryCount;
+    quint32 entryCount;
+    quint32 directoriesOffset;
+    quint32 entriesOffset;
+    quint32 reserved[2];
+};
+
+enum DirectoryKind {
+    PluginDirectory = 0,
+    ProviderDirectory,
+};
+
+struct IndexDirectory
+{
+    qint64 mtime;
+    quint32 mtimeNsec;
+    quint32 kind;
+    quint32 pathOffset;
+    quint32 pathLength;
+};
+
+struct IndexEntry
+{
+    quint32 keyOffset;
+    quint32 keyLength;
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint32 fileNameOffset;
+    quint32 fileNameLength;
+    quint32 libraryPathOffset;
+    quint32 libraryPathLength;
+};
+
+static bool directoryTime(const QString &path, qint64 &mtime, quint32 &nsec)
+{
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0)
+        return false;
+
+    mtime = st.st_mtim.tv_sec;
+    nsec = st.st_mtim.tv_nsec;
+    return true;
+}
+
+static bool isAscii(const QString &string)
+{
+    for (int i = 0; i < string.length(); i++) {
+        if (string[i].unicode() >= 0x80)
+            return false;
+    }
+    return true;
+}
+
+/* Compares an ASCII QString with an ASCII key from the index, without
+ * converting either of them. */
+static int compareKey(const QString &name, const char *key, quint32 length)
+{
+    const QChar *chars = name.constData();
+    int nameLength = name.length();
+    int common = qMin(nameLength, int(length));
+
+    for (int i = 0; i < common; i++) {
+        ushort a = chars[i].unicode();
+        uchar b = key[i];
+        if (a != b)
+            return a < b ? -1 : 1;
+    }
+
+    return nameLength - int(length);
+}
+
+static quint32 appendString(QByteArray &strings, quint32 base,
+                            const QByteArray &string)
+{
+    quint32 offset = base + strings.size();
+    strings.append(string);
+    return offset;
+}
+
+PluginIndex::PluginIndex():
+    data(0),
+    size(0)
+{
+}
+
+PluginIndex::~PluginIndex()
+{
+    close();
+}
+
+QString PluginIndex::defaultFileName()
+{
+    QByteArray envFile = qgetenv("ACCOUNTSETUP_PLUGIN_INDEX");
+    if (!envFile.isEmpty())
+        return QString::fromLocal8Bit(envFile);
+
+    /* Outside of the plugin directory, or writing the index would change
+     * the directory it describes. */
+    return QLatin1String("/usr/lib/AccountSetup.index");
+}
+
+bool PluginIndex::build(const QString &fileName, Manager *manager,
+                        const QStringList &pluginDirs)
+{
+    QMap<QByteArray, PluginLocation> locations;
+
+    foreach (Provider provider, manager->providerList()) {
+        QString providerName = provider.name();
+        if (!isAscii(providerName)) {
+            qWarning() << "Not indexing provider" << providerName;
+            continue;
+        }
+
+        locations.insert(providerName.toLatin1(),
+                         PluginResolver::scan(provider, pluginDirs));
+    }
+
+    /* All of them, even those without any provider or missing: a provider
+     * file installed there could shadow one from another directory. */
+    QStringList providerDirs = PluginResolver::providerDirectories();
+
+    QList<IndexDirectory> directories;
+    QByteArray strings;
+
+    IndexHeader header;
+    memcpy(header.magic, indexMagic, sizeof(header.magic));
+    header.version = indexVersion;
+    header.directoryCount = pluginDirs.count() + providerDirs.count();
+    header.entryCount = locations.count();
+    header.directoriesOffset = sizeof(IndexHeader);
+    header.entriesOffset = header.directoriesOffset +
+        header.directoryCount * sizeof(IndexDirectory);
+    header.reserved[0] = header.reserved[1] = 0;
+
+    quint32 stringsOffset = header.entriesOffset +
+        header.entryCount * sizeof(IndexEntry);
+
+    QStringList allDirs = pluginDirs + providerDirs;
+    for (int i = 0; i < allDirs.count(); i++) {
+        IndexDirectory directory;
+        /* a missing directory is recorded as such: creating it later makes
+         * the index stale */
+        if (!directoryTime(allDirs[i], directory.mtime, directory.mtimeNsec)) {
+            directory.mtime = -1;
+            directory.mtimeNsec = 0;
+        }
+        directory.kind = i < pluginDirs.count() ?
+            PluginDirectory : ProviderDirectory;
+        QByteArray path = QFile::encodeName(allDirs[i]);
+        directory.pathOffset = appendString(strings, stringsOffset, path);
+        directory.pathLength = path.length();
+        directories.append(directory);
+    }
+
+    QByteArray contents;
+    contents.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    foreach (const IndexDirectory &directory, directories) {
+        contents.append(reinterpret_cast<const char *>(&directory),
+                        sizeof(directory));
+    }
+
+    /* QMap iterates in key order, which is the lookup order */
+    QMap<QByteArray, PluginLocation>::const_iterator i;
+    for (i = locations.constBegin(); i != locations.constEnd(); ++i) {
+        IndexEntry entry;
+        QByteArray path = i->path.toUtf8();
+        QByteArray pluginFileName = i->fileName.toUtf8();
+        entry.keyOffset = appendString(strings, stringsOffset, i.key());
+        entry.keyLength = i.key().length();
+        entry.pathOffset = appendString(strings, stringsOffset, path);
+        entry.pathLength = path.length();
+        entry.fileNameOffset = appendString(strings, stringsOffset,
+                                            pluginFileName);
+        entry.fileNameLength = pluginFileName.length();
+        QByteArray libraryPath = i->libraryPath.toUtf8();
+        entry.libraryPathOffset = appendString(strings, stringsOffset,
+                                               libraryPath);
+        entry.libraryPathLength = libraryPath.length();
+        contents.append(reinterpret_cast<const char *>(&entry),
+                        sizeof(entry));
+    }
+    contents.append(strings);
+
+    /* replace the old index atomically, it might be mapped by someone */
+    QString tmpFileName = fileName + QLatin1String(".tmp");
+    QFile tmpFile(tmpFileName);
+    if (!tmpFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write" << tmpFileName;
+        return false;
+    }
+    bool ok = tmpFile.write(contents) == contents.size() && tmpFile.flush();
+    tmpFile.close();
+
+    if (!ok || rename(QFile::encodeName(tmpFileName).constData(),
+                      QFile::encodeName(fileName).constData()) != 0) {
+        qWarning() << "Cannot write" << fileName;
+        QFile::remove(tmpFileName);
+        return false;
+    }
+
+    return true;
+}
+
+bool PluginIndex::open(const QString &fileName)
+{
+    close();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    size = file.size();
+    if (size >= (qint64)sizeof(IndexHeader))
+        data = file.map(0, size);
+    if (data == 0) {
+        close();
+        return false;
+    }
+
+    /* Validate everything once here, so that lookup() can trust the
+     * offsets. */
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(data);
+    bool valid = memcmp(header->magic, indexMagic, sizeof(indexMagic)) == 0 &&
+        header->version == indexVersion &&
+        header->directoriesOffset + (qint64)header->directoryCount *
+        sizeof(IndexDirectory) <= size &&
+        header->entriesOffset + (qint64)header->entryCount *
+        sizeof(IndexEntry) <= size;
+
+    const IndexDirectory *directories =
+        reinterpret_cast<const IndexDirectory *>(data +
+                                                 header->directoriesOffset);
+    for (quint32 i = 0; valid && i < header->directoryCount; i++) {
+        const IndexDirectory &directory = directories[i];
+        if (directory.pathOffset + (qint64)directory.pathLength > size) {
+            valid = false;
+            break;
+        }
+
+        QString path = QFile::decodeName(
+            QByteArray(reinterpret_cast<const char *>(data) +
+                       directory.pathOffset, directory.pathLength));
+        if (directory.kind == PluginDirectory)
+            pluginDirs << path;
+        else
+            providerDirs << path;
+        watchedDirs << path;
+    }
+
+    const IndexEntry *entries =
+        reinterpret_cast<const IndexEntry *>(data + header->entriesOffset);
+    for (quint32 i = 0; valid && i < header->entryCount; i++) {
+        const IndexEntry &entry = entries[i];
+        if (entry.keyOffset + (qint64)entry.keyLength > size ||
+            entry.pathOffset + (qint64)entry.pathLength > size ||
+            entry.fileNameOffset + (qint64)entry.fileNameLength > size ||
+            entry.libraryPathOffset + (qint64)entry.libraryPathLength > size)
+            valid = false;
+    }
+
+    if (!valid) {
+        qWarning() << "Invalid plugin index" << fileName;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void PluginIndex::close()
+{
+    if (data != 0)
+        file.unmap(const_cast<uchar *>(data));
+    file.close();
+    data = 0;
+    size = 0;
+    pluginDirs.clear();
+    providerDirs.clear();
+    watchedDirs.clear();
+}
+
+bool PluginIndex::isStale() const
+{
+    if (data == 0)
+        return true;
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(data);
+    const IndexDirectory *directories =
+        reinterpret_cast<const IndexDirectory *>(data +
+                                                 header->directoriesOffset);
+    for (quint32 i = 0; i < header->directoryCount; i++) {
+        qint64 mtime = -1;
+        quint32 nsec = 0;
+        directoryTime(watchedDirs[i], mtime, nsec);
+        if (mtime != directories[i].mtime || nsec != directories[i].mtimeNsec)
+            return true;
+    }
+
+    return false;
+}
+
+bool PluginIndex::lookup(const QString &providerName,
+                         PluginLocation &location) const
+{
+    if (data == 0)
+        return false;
+
+    const IndexHeader *header = reinterpret_cast<const IndexHeader *>(data);
+    const IndexEntry *entries =
+        reinterpret_cast<const IndexEntry *>(data + header->entriesOffset);
+    const char *strings = reinterpret_cast<const char *>(data);
+
+    int low = 0;
+    int high = int(header->entryCount) - 1;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        const IndexEntry &entry = entries[middle];
+        int result = compareKey(providerName, strings + entry.keyOffset,
+                                entry.keyLength);
+        if (result < 0) {
+            high = middle - 1;
+        } else if (result > 0) {
+            low = middle + 1;
+        } else {
+            location.path = QString::fromUtf8(strings + entry.pathOffset,
+                                              entry.pathLength);
+            location.fileName =
+                QString::fromUtf8(strings + entry.fileNameOffset,
+                                  entry.fileNameLength);
+            location.libraryPath =
+                QString::fromUtf8(strings + entry.libraryPathOffset,
+                                  entry.libraryPathLength);
+            return true;
+        }
+    }
+
+    return false;
+}
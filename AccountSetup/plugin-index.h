@@ -0,0 +1,83 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTSETUP_PLUGIN_INDEX_H
+#define ACCOUNTSETUP_PLUGIN_INDEX_H
+
+//libAccountSetup
+#include "plugin-resolver.h"
+
+//Qt
+#include <QFile>
+#include <QStringList>
+
+namespace Accounts {
+class Manager;
+}
+
+namespace AccountSetup {
+
+/*
+ * Read-only, memory mapped table from provider IDs to plugin executables,
+ * built by the accountsetup-plugin-index tool for a given list of plugin
+ * directories. The index records the modification times of the plugin and
+ * provider directories, so that a stale index can be detected and ignored.
+ * Provider IDs which are not plain ASCII are left out of the index.
+ */
+class PluginIndex
+{
+public:
+    PluginIndex();
+    ~PluginIndex();
+
+    static QString defaultFileName();
+    static bool build(const QString &fileName, Accounts::Manager *manager,
+                      const QStringList &pluginDirs);
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return data != 0; }
+    bool isStale() const;
+
+    QStringList pluginDirectories() const { return pluginDirs; }
+    QStringList providerDirectories() const { return providerDirs; }
+    QStringList watchedDirectories() const { return watchedDirs; }
+
+    /* Returns false if the provider is not in the index; an invalid
+     * location means that the provider has no plugin. */
+    bool lookup(const QString &providerName, PluginLocation &location) const;
+
+private:
+    Q_DISABLE_COPY(PluginIndex)
+
+    QFile file;
+    const uchar *data;
+    qint64 size;
+    QStringList pluginDirs;
+    QStringList providerDirs;
+    QStringList watchedDirs;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_INDEX_H
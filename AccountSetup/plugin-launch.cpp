@@ -0,0 +1,58 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-launch.h"
+
+#include <QDataStream>
+
+using namespace AccountSetup;
+
+/* bumped when the fields change */
+static const quint16 launchFormat = 1;
+
+QByteArray PluginLaunch::encode() const
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << launchFormat << quint8(setupType) << windowId <<
+        providerName << quint32(accountId) << accountSnapshot <<
+        serviceType << parameters << arguments << flags;
+    return payload;
+}
+
+bool PluginLaunch::decode(const QByteArray &payload)
+{
+    QDataStream stream(payload);
+    quint16 format = 0;
+    stream >> format;
+    if (format != launchFormat)
+        return false;
+
+    quint8 type;
+    quint32 id;
+    stream >> type >> windowId >> providerName >> id >> accountSnapshot >>
+        serviceType >> parameters >> arguments >> flags;
+    setupType = SetupType(type);
+    accountId = id;
+
+    return stream.status() == QDataStream::Ok;
+}
@@ -0,0 +1,78 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_LAUNCH_H
+#define ACCOUNTSETUP_PLUGIN_LAUNCH_H
+
+//libAccountSetup
+#include "types.h"
+
+//Accounts
+#include <Accounts/account.h>
+
+//Qt
+#include <QByteArray>
+#include <QStringList>
+#include <QVariantMap>
+
+namespace AccountSetup {
+
+/*
+ * Everything a plugin needs to know about its task, sent by the caller in
+ * the Launch message: the plugin doesn't have to parse its command line,
+ * and the size of the launch context isn't limited by that of argv.
+ */
+struct PluginLaunch
+{
+    enum Flag {
+        /* send the startup phases in Trace messages */
+        Trace = 1 << 0,
+    };
+
+    PluginLaunch():
+        setupType(Unset),
+        windowId(0),
+        accountId(0),
+        flags(0)
+    {
+    }
+
+    QByteArray encode() const;
+    bool decode(const QByteArray &payload);
+
+    SetupType setupType;
+    quint64 windowId;
+    /* the provider of the account to create */
+    QString providerName;
+    /* the account to edit, and its settings as the caller last saw them */
+    Accounts::AccountId accountId;
+    QVariantMap accountSnapshot;
+    QString serviceType;
+    QVariantMap parameters;
+    /* the same task, as the command line used by older plugins */
+    QStringList arguments;
+    quint32 flags;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_LAUNCH_H
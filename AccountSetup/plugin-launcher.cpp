@@ -0,0 +1,465 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-launcher.h"
+#include "plugin-channel.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QPointer>
+#include <QVector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+using namespace AccountSetup;
+
+/* where a spawned plugin finds the ends of its socket pairs */
+static const int childChannelFd = 3;
+static const int childDescriptorFd = 4;
+/* the descriptors duplicated in the child are first moved above these */
+static const int firstHighFd = 10;
+/* read at most this much output at once, not to starve the event loop */
+static const int maxOutputChunks = 16;
+
+static int childSignalPipe[2] = { -1, -1 };
+static struct sigaction previousChildAction;
+
+static void closeFd(int &fd)
+{
+    if (fd >= 0)
+        ::close(fd);
+    fd = -1;
+}
+
+PluginLauncher::PluginLauncher(QObject *parent):
+    QObject(parent)
+{
+}
+
+PluginLauncher::~PluginLauncher()
+{
+}
+
+PluginLauncher *PluginLauncher::create(ProviderPluginProxy::Launcher launcher,
+                                       QObject *parent)
+{
+    if (launcher == ProviderPluginProxy::SpawnLauncher)
+        return new PluginSpawnLauncher(parent);
+    return new PluginForkLauncher(parent);
+}
+
+PluginForkLauncher::PluginForkLauncher(QObject *parent):
+    PluginLauncher(parent),
+    m_process(new PluginChannelProcess(this))
+{
+    m_process->setProcessChannelMode(QProcess::MergedChannels);
+    connect(m_process, SIGNAL(readyReadStandardOutput()),
+            this, SIGNAL(readyReadStandardOutput()));
+    connect(m_process, SIGNAL(error(QProcess::ProcessError)),
+            this, SIGNAL(error(QProcess::ProcessError)));
+    connect(m_process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SIGNAL(finished(int, QProcess::ExitStatus)));
+}
+
+PluginForkLauncher::~PluginForkLauncher()
+{
+}
+
+PluginChannel *
+PluginForkLauncher::startWithChannel(const QString &program,
+                                     const QStringList &arguments)
+{
+    return m_process->startWithChannel(program, arguments);
+}
+
+QProcess::ProcessState PluginForkLauncher::state() const
+{
+    return m_process->state();
+}
+
+qint64 PluginForkLauncher::processId() const
+{
+    return qint64(m_process->pid());
+}
+
+qint64 PluginForkLauncher::read(char *data, qint64 maxSize)
+{
+    return m_process->read(data, maxSize);
+}
+
+void PluginForkLauncher::terminate()
+{
+    m_process->terminate();
+}
+
+void PluginForkLauncher::kill()
+{
+    m_process->kill();
+}
+
+static void childSignalHandler(int signum, siginfo_t *info, void *context)
+{
+    /* a full pipe has wake-ups pending already */
+    int savedErrno = errno;
+    char byte = 0;
+    if (::write(childSignalPipe[1], &byte, 1) < 0) {
+        /* nothing to do */
+    }
+    errno = savedErrno;
+
+    if (previousChildAction.sa_flags & SA_SIGINFO) {
+        if (previousChildAction.sa_sigaction != 0)
+            previousChildAction.sa_sigaction(signum, info, context);
+    } else if (previousChildAction.sa_handler != SIG_DFL &&
+               previousChildAction.sa_handler != SIG_IGN) {
+        previousChildAction.sa_handler(signum);
+    }
+}
+
+PluginChildWatcher::PluginChildWatcher():
+    QObject(0),
+    m_notifier(0)
+{
+    if (::pipe2(childSignalPipe, O_CLOEXEC | O_NONBLOCK) < 0) {
+        qWarning() << "Cannot watch the plugin processes:" << strerror(errno);
+        return;
+    }
+
+    m_notifier = new QSocketNotifier(childSignalPipe[0],
+                                     QSocketNotifier::Read, this);
+    connect(m_notifier, SIGNAL(activated(int)),
+            this, SLOT(onChildSignal()));
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = childSignalHandler;
+    action.sa_flags = SA_SIGINFO | SA_NOCLDSTOP | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGCHLD, &action, &previousChildAction);
+}
+
+PluginChildWatcher *PluginChildWatcher::instance()
+{
+    /* never destroyed: the signal handler stays installed */
+    static PluginChildWatcher *watcher = new PluginChildWatcher();
+    return watcher;
+}
+
+void PluginChildWatcher::add(PluginSpawnLauncher *launcher)
+{
+    m_launchers.append(launcher);
+}
+
+void PluginChildWatcher::remove(PluginSpawnLauncher *launcher)
+{
+    m_launchers.removeAll(launcher);
+}
+
+void PluginChildWatcher::onChildSignal()
+{
+    char buffer[64];
+    while (::read(childSignalPipe[0], buffer, sizeof(buffer)) > 0) {}
+
+    /* the signal doesn't tell which child exited, and several might have;
+     * launchers can be deleted by the slots of their finished() */
+    QList<QPointer<PluginSpawnLauncher> > launchers;
+    foreach (PluginSpawnLauncher *launcher, m_launchers)
+        launchers.append(launcher);
+
+    foreach (QPointer<PluginSpawnLauncher> launcher, launchers) {
+        if (!launcher.isNull())
+            launcher->reap();
+    }
+}
+
+PluginSpawnLauncher::PluginSpawnLauncher(QObject *parent):
+    PluginLauncher(parent),
+    m_pid(0),
+    m_outputFd(-1),
+    m_outputNotifier(0)
+{
+}
+
+PluginSpawnLauncher::~PluginSpawnLauncher()
+{
+    /* as QProcess does; the reaper makes sure it doesn't happen often */
+    if (m_pid > 0) {
+        ::kill(m_pid, SIGKILL);
+        while (::waitpid(m_pid, 0, 0) < 0 && errno == EINTR) {}
+        PluginChildWatcher::instance()->remove(this);
+    }
+    closeOutput();
+}
+
+PluginChannel *
+PluginSpawnLauncher::startWithChannel(const QString &program,
+                                      const QStringList &arguments)
+{
+    /* the handler must be in place before the child can exit */
+    PluginChildWatcher::instance();
+
+    int fds[2] = { -1, -1 };
+    int descriptorFds[2] = { -1, -1 };
+    QStringList channelArguments;
+    if (PluginChannel::createSocketPair(fds)) {
+        channelArguments << QLatin1String("--channelFd") <<
+            QString::number(childChannelFd);
+
+        /* without it, results are sent inline */
+        if (PluginChannel::createSocketPair(descriptorFds))
+            channelArguments << QLatin1String("--descriptorFd") <<
+                QString::number(childDescriptorFd);
+    } else {
+        qWarning() << "Cannot create the plugin channel";
+    }
+
+    bool started = spawn(program, arguments + channelArguments,
+                         fds[1], descriptorFds[1]);
+    closeFd(fds[1]);
+    closeFd(descriptorFds[1]);
+
+    if (!started) {
+        closeFd(fds[0]);
+        closeFd(descriptorFds[0]);
+        /* reported from the event loop, like QProcess does */
+        QMetaObject::invokeMethod(this, "onFailedToStart",
+                                  Qt::QueuedConnection);
+        return 0;
+    }
+
+    if (fds[0] < 0)
+        return 0;
+    return PluginChannel::fromDescriptors(fds[0], descriptorFds[0]);
+}
+
+bool PluginSpawnLauncher::spawn(const QString &program,
+                                const QStringList &arguments,
+                                int channelFd, int descriptorFd)
+{
+    int outputFds[2];
+    if (::pipe2(outputFds, O_CLOEXEC) < 0) {
+        qWarning() << "Cannot create the output pipe:" << strerror(errno);
+        return false;
+    }
+
+    /* Out of the way of the descriptors they are duplicated to; the
+     * copies are closed on exec, only their duplicates are inherited. */
+    int sources[3] = { outputFds[1], channelFd, descriptorFd };
+    bool duplicated = true;
+    for (int i = 0; i < 3; i++) {
+        if (sources[i] < 0)
+            continue;
+        sources[i] = ::fcntl(sources[i], F_DUPFD_CLOEXEC, firstHighFd);
+        if (sources[i] < 0)
+            duplicated = false;
+    }
+    closeFd(outputFds[1]);
+
+    if (!duplicated) {
+        qWarning() << "Cannot set up the plugin descriptors:" <<
+            strerror(errno);
+        for (int i = 0; i < 3; i++)
+            closeFd(sources[i]);
+        closeFd(outputFds[0]);
+        return false;
+    }
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null",
+                                     O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, sources[0], STDOUT_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, sources[0], STDERR_FILENO);
+    if (sources[1] >= 0)
+        posix_spawn_file_actions_adddup2(&actions, sources[1], childChannelFd);
+    if (sources[2] >= 0)
+        posix_spawn_file_actions_adddup2(&actions, sources[2],
+                                         childDescriptorFd);
+
+    /* the child starts with a clean signal state, as after fork() and
+     * the reset done by QProcess */
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGPIPE);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    posix_spawnattr_setflags(&attributes, flags);
+
+    QList<QByteArray> encoded;
+    encoded << QFile::encodeName(program);
+    foreach (const QString &argument, arguments)
+        encoded << argument.toLocal8Bit();
+    QVector<char *> argv;
+    for (int i = 0; i < encoded.count(); i++)
+        argv.append(encoded[i].data());
+    argv.append(0);
+
+    pid_t pid = 0;
+    int result = ::posix_spawnp(&pid, argv[0], &actions, &attributes,
+                                argv.data(), environ);
+
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    for (int i = 0; i < 3; i++)
+        closeFd(sources[i]);
+
+    if (result != 0) {
+        qWarning() << "Cannot start" << program << ":" << strerror(result);
+        closeFd(outputFds[0]);
+        return false;
+    }
+
+    m_pid = pid;
+    PluginChildWatcher::instance()->add(this);
+
+    ::fcntl(outputFds[0], F_SETFL, O_NONBLOCK);
+    m_outputFd = outputFds[0];
+    m_outputNotifier = new QSocketNotifier(m_outputFd,
+                                           QSocketNotifier::Read, this);
+    connect(m_outputNotifier, SIGNAL(activated(int)),
+            this, SLOT(onOutputReady()));
+
+    /* if it has exited already, the signal is waiting in the pipe */
+    return true;
+}
+
+QProcess::ProcessState PluginSpawnLauncher::state() const
+{
+    return m_pid > 0 ? QProcess::Running : QProcess::NotRunning;
+}
+
+qint64 PluginSpawnLauncher::processId() const
+{
+    return m_pid > 0 ? qint64(m_pid) : 0;
+}
+
+qint64 PluginSpawnLauncher::read(char *data, qint64 maxSize)
+{
+    int length = int(qMin(maxSize, qint64(m_output.size())));
+    if (length <= 0)
+        return 0;
+
+    memcpy(data, m_output.constData(), length);
+    m_output.remove(0, length);
+    return length;
+}
+
+void PluginSpawnLauncher::terminate()
+{
+    if (m_pid > 0)
+        ::kill(m_pid, SIGTERM);
+}
+
+void PluginSpawnLauncher::kill()
+{
+    if (m_pid > 0)
+        ::kill(m_pid, SIGKILL);
+}
+
+void PluginSpawnLauncher::onOutputReady()
+{
+    if (m_outputFd < 0)
+        return;
+
+    char chunk[4096];
+    bool received = false;
+    for (int i = 0; i < maxOutputChunks; i++) {
+        ssize_t length = ::read(m_outputFd, chunk, sizeof(chunk));
+        if (length > 0) {
+            m_output.append(chunk, int(length));
+            received = true;
+            continue;
+        }
+        if (length < 0 && errno == EINTR)
+            continue;
+
+        /* end of file, or an error: nothing more will come */
+        if (length == 0 || errno != EAGAIN)
+            closeOutput();
+        break;
+    }
+
+    if (received)
+        emit readyReadStandardOutput();
+}
+
+void PluginSpawnLauncher::closeOutput()
+{
+    delete m_outputNotifier;
+    m_outputNotifier = 0;
+    closeFd(m_outputFd);
+}
+
+void PluginSpawnLauncher::reap()
+{
+    if (m_pid <= 0)
+        return;
+
+    int status = 0;
+    pid_t pid;
+    do {
+        pid = ::waitpid(m_pid, &status, WNOHANG);
+    } while (pid < 0 && errno == EINTR);
+    if (pid == 0)
+        return;
+
+    m_pid = 0;
+    PluginChildWatcher::instance()->remove(this);
+
+    /* what the plugin wrote last comes before finished(), as with
+     * QProcess; a child of the plugin could keep the pipe open forever */
+    while (m_outputFd >= 0) {
+        int before = m_output.size();
+        onOutputReady();
+        if (m_output.size() == before)
+            break;
+    }
+    closeOutput();
+
+    if (pid > 0 && WIFEXITED(status)) {
+        emit finished(WEXITSTATUS(status), QProcess::NormalExit);
+    } else {
+        emit error(QProcess::Crashed);
+        emit finished(pid > 0 && WIFSIGNALED(status) ? WTERMSIG(status) : -1,
+                      QProcess::CrashExit);
+    }
+}
+
+void PluginSpawnLauncher::onFailedToStart()
+{
+    emit error(QProcess::FailedToStart);
+}
@@ -0,0 +1,165 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_LAUNCHER_H
+#define ACCOUNTSETUP_PLUGIN_LAUNCHER_H
+
+//libAccountSetup
+#include "provider-plugin-proxy.h"
+
+//Qt
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QProcess>
+#include <QSocketNotifier>
+#include <QStringList>
+
+namespace AccountSetup {
+
+class PluginChannel;
+class PluginChannelProcess;
+
+/*
+ * A plugin process, connected to the caller through a PluginChannel, with
+ * its standard output and error merged. The signals are those of QProcess,
+ * and are emitted in the same circumstances, whichever way the process was
+ * created.
+ */
+class PluginLauncher: public QObject
+{
+    Q_OBJECT
+
+public:
+    static PluginLauncher *create(ProviderPluginProxy::Launcher launcher,
+                                  QObject *parent = 0);
+    virtual ~PluginLauncher();
+
+    /* Starts the process and returns the caller's end of the channel, or 0
+     * if the channel cannot be set up. */
+    virtual PluginChannel *startWithChannel(const QString &program,
+                                            const QStringList &arguments) = 0;
+
+    virtual QProcess::ProcessState state() const = 0;
+    /* 0 when not running */
+    virtual qint64 processId() const = 0;
+    virtual qint64 read(char *data, qint64 maxSize) = 0;
+    virtual void terminate() = 0;
+    virtual void kill() = 0;
+
+Q_SIGNALS:
+    void readyReadStandardOutput();
+    void error(QProcess::ProcessError error);
+    void finished(int exitCode, QProcess::ExitStatus exitStatus);
+
+protected:
+    PluginLauncher(QObject *parent);
+};
+
+/* QProcess, which forks the caller */
+class PluginForkLauncher: public PluginLauncher
+{
+    Q_OBJECT
+
+public:
+    PluginForkLauncher(QObject *parent = 0);
+    ~PluginForkLauncher();
+
+    PluginChannel *startWithChannel(const QString &program,
+                                    const QStringList &arguments);
+    QProcess::ProcessState state() const;
+    qint64 processId() const;
+    qint64 read(char *data, qint64 maxSize);
+    void terminate();
+    void kill();
+
+private:
+    PluginChannelProcess *m_process;
+};
+
+class PluginSpawnLauncher;
+
+/* Wakes up the spawned launchers when SIGCHLD arrives, so that they can
+ * reap their own children; other handlers of the signal, such as the one
+ * of QProcess, keep working. */
+class PluginChildWatcher: public QObject
+{
+    Q_OBJECT
+
+public:
+    static PluginChildWatcher *instance();
+
+    void add(PluginSpawnLauncher *launcher);
+    void remove(PluginSpawnLauncher *launcher);
+
+private Q_SLOTS:
+    void onChildSignal();
+
+private:
+    PluginChildWatcher();
+
+    QList<PluginSpawnLauncher *> m_launchers;
+    QSocketNotifier *m_notifier;
+};
+
+/*
+ * posix_spawn(), which doesn't copy the page tables of the caller: the
+ * cost of starting a plugin doesn't grow with the size of the caller.
+ * Children are reaped when SIGCHLD arrives.
+ */
+class PluginSpawnLauncher: public PluginLauncher
+{
+    Q_OBJECT
+
+public:
+    PluginSpawnLauncher(QObject *parent = 0);
+    ~PluginSpawnLauncher();
+
+    PluginChannel *startWithChannel(const QString &program,
+                                    const QStringList &arguments);
+    QProcess::ProcessState state() const;
+    qint64 processId() const;
+    qint64 read(char *data, qint64 maxSize);
+    void terminate();
+    void kill();
+
+    /* called when any child might have exited */
+    void reap();
+
+private Q_SLOTS:
+    void onOutputReady();
+    void onFailedToStart();
+
+private:
+    bool spawn(const QString &program, const QStringList &arguments,
+               int channelFd, int descriptorFd);
+    void closeOutput();
+
+    pid_t m_pid;
+    int m_outputFd;
+    QSocketNotifier *m_outputNotifier;
+    QByteArray m_output;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_LAUNCHER_H
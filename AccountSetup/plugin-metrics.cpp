@@ -0,0 +1,285 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-metrics.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVariantList>
+
+using namespace AccountSetup;
+
+namespace AccountSetup {
+
+struct PluginMetricsEntry
+{
+    enum Counter {
+        Launches = 0,
+        Succeeded,
+        AccountNotFound,
+        PluginNotFound,
+        PluginCrashed,
+        FailedToStart,
+        Cancelled,
+        ResultLost,
+        /* any error without a counter of its own */
+        Other,
+        CounterCount
+    };
+
+    QVariantMap snapshot() const;
+
+    QAtomicInt counters[CounterCount];
+    PluginHistogram queueTime;
+    PluginHistogram duration;
+    PluginHistogram payloadSize;
+};
+
+} // namespace
+
+namespace {
+
+const char *counterNames[PluginMetricsEntry::CounterCount] = {
+    "launches",
+    "succeeded",
+    "accountNotFound",
+    "pluginNotFound",
+    "pluginCrashed",
+    "failedToStart",
+    "cancelled",
+    "resultLost",
+    "other",
+};
+
+/* Entries are only ever added, so that the pointers held by the recorders
+ * stay valid; there's one for each provider and plugin name seen. */
+class PluginMetricsRegistry
+{
+public:
+    static PluginMetricsRegistry *instance()
+    {
+        /* never destroyed: sessions might record until the very end */
+        static PluginMetricsRegistry *registry = new PluginMetricsRegistry();
+        return registry;
+    }
+
+    PluginMetricsEntry *total() { return &m_total; }
+
+    PluginMetricsEntry *providerEntry(const QString &name)
+    {
+        return entry(m_providers, name);
+    }
+
+    PluginMetricsEntry *pluginEntry(const QString &name)
+    {
+        return entry(m_plugins, name);
+    }
+
+    QVariantMap snapshot()
+    {
+        QMutexLocker locker(&m_mutex);
+        QVariantMap providers;
+        QHash<QString, PluginMetricsEntry*>::const_iterator i;
+        for (i = m_providers.constBegin(); i != m_providers.constEnd(); ++i)
+            providers.insert(i.key(), i.value()->snapshot());
+        QVariantMap plugins;
+        for (i = m_plugins.constBegin(); i != m_plugins.constEnd(); ++i)
+            plugins.insert(i.key(), i.value()->snapshot());
+
+        QVariantMap snapshot;
+        snapshot.insert(QLatin1String("total"), m_total.snapshot());
+        snapshot.insert(QLatin1String("providers"), providers);
+        snapshot.insert(QLatin1String("plugins"), plugins);
+        return snapshot;
+    }
+
+private:
+    PluginMetricsEntry *entry(QHash<QString, PluginMetricsEntry*> &entries,
+                              const QString &name)
+    {
+        QMutexLocker locker(&m_mutex);
+        PluginMetricsEntry *&entry = entries[name];
+        if (entry == 0)
+            entry = new PluginMetricsEntry;
+        return entry;
+    }
+
+    QMutex m_mutex;
+    PluginMetricsEntry m_total;
+    QHash<QString, PluginMetricsEntry*> m_providers;
+    QHash<QString, PluginMetricsEntry*> m_plugins;
+};
+
+} // namespace
+
+PluginHistogram::PluginHistogram()
+{
+}
+
+void PluginHistogram::add(qint64 value)
+{
+    int bucket = 0;
+    for (quint64 v = quint64(qMax(value, qint64(0))); v != 0; v >>= 1)
+        bucket++;
+    bucket = qMin(bucket, int(BucketCount) - 1);
+
+    int clamped = int(qMin(qMax(value, qint64(0)), qint64(0x7fffffff)));
+    m_buckets[bucket].fetchAndAddRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+
+    int max = m_max;
+    while (clamped > max && !m_max.testAndSetRelaxed(max, clamped))
+        max = m_max;
+}
+
+qint64 PluginHistogram::percentile(int count, int percent) const
+{
+    /* the rank of the value, rounded up */
+    qint64 rank = (qint64(count) * percent + 99) / 100;
+    qint64 seen = 0;
+    for (int i = 0; i < BucketCount; i++) {
+        seen += int(m_buckets[i]);
+        if (seen >= rank) {
+            qint64 upper = i == 0 ? 0 : (qint64(1) << i) - 1;
+            return qMin(upper, qint64(int(m_max)));
+        }
+    }
+    return int(m_max);
+}
+
+QVariantMap PluginHistogram::snapshot() const
+{
+    int count = m_count;
+
+    QVariantMap buckets;
+    for (int i = 0; i < BucketCount; i++) {
+        int value = m_buckets[i];
+        if (value == 0)
+            continue;
+        qint64 upper = i == 0 ? 0 : (qint64(1) << i) - 1;
+        buckets.insert(QString::number(upper), value);
+    }
+
+    QVariantMap snapshot;
+    snapshot.insert(QLatin1String("count"), count);
+    snapshot.insert(QLatin1String("max"), int(m_max));
+    if (count > 0) {
+        snapshot.insert(QLatin1String("p50"), percentile(count, 50));
+        snapshot.insert(QLatin1String("p90"), percentile(count, 90));
+        snapshot.insert(QLatin1String("p99"), percentile(count, 99));
+    }
+    snapshot.insert(QLatin1String("buckets"), buckets);
+    return snapshot;
+}
+
+QVariantMap PluginMetricsEntry::snapshot() const
+{
+    QVariantMap snapshot;
+    for (int i = 0; i < CounterCount; i++)
+        snapshot.insert(QLatin1String(counterNames[i]), int(counters[i]));
+    snapshot.insert(QLatin1String("queueTime"), queueTime.snapshot());
+    snapshot.insert(QLatin1String("duration"), duration.snapshot());
+    snapshot.insert(QLatin1String("payloadSize"), payloadSize.snapshot());
+    return snapshot;
+}
+
+PluginMetrics::PluginMetrics():
+    m_launched(false)
+{
+    m_entries[Total] = PluginMetricsRegistry::instance()->total();
+    m_entries[Provider] = 0;
+    m_entries[Plugin] = 0;
+}
+
+void PluginMetrics::setProvider(const QString &providerName)
+{
+    m_entries[Provider] =
+        PluginMetricsRegistry::instance()->providerEntry(providerName);
+}
+
+void PluginMetrics::setPlugin(const QString &pluginName)
+{
+    m_entries[Plugin] =
+        PluginMetricsRegistry::instance()->pluginEntry(pluginName);
+}
+
+void PluginMetrics::launched()
+{
+    m_launched = true;
+    for (int i = 0; i < EntryCount; i++) {
+        if (m_entries[i] != 0)
+            m_entries[i]->counters[PluginMetricsEntry::Launches]
+                .fetchAndAddRelaxed(1);
+    }
+}
+
+void PluginMetrics::finished(ProviderPluginProxy::Error error,
+                             bool failedToStart, qint64 queueTime,
+                             qint64 duration, qint64 payloadSize)
+{
+    int counter;
+    switch (error) {
+    case ProviderPluginProxy::NoError:
+        counter = PluginMetricsEntry::Succeeded;
+        break;
+    case ProviderPluginProxy::AccountNotFound:
+        counter = PluginMetricsEntry::AccountNotFound;
+        break;
+    case ProviderPluginProxy::PluginNotFound:
+        counter = PluginMetricsEntry::PluginNotFound;
+        break;
+    case ProviderPluginProxy::PluginCrashed:
+        counter = failedToStart ?
+            PluginMetricsEntry::FailedToStart :
+            PluginMetricsEntry::PluginCrashed;
+        break;
+    case ProviderPluginProxy::Cancelled:
+        counter = PluginMetricsEntry::Cancelled;
+        break;
+    case ProviderPluginProxy::ResultLost:
+        counter = PluginMetricsEntry::ResultLost;
+        break;
+    default:
+        counter = PluginMetricsEntry::Other;
+        break;
+    }
+
+    for (int i = 0; i < EntryCount; i++) {
+        PluginMetricsEntry *entry = m_entries[i];
+        if (entry == 0)
+            continue;
+        entry->counters[counter].fetchAndAddRelaxed(1);
+        /* a plugin which never ran would only skew the latencies */
+        if (m_launched) {
+            entry->queueTime.add(queueTime);
+            entry->duration.add(duration);
+        }
+        if (error == ProviderPluginProxy::NoError)
+            entry->payloadSize.add(payloadSize);
+    }
+}
+
+QVariantMap PluginMetrics::snapshot()
+{
+    return PluginMetricsRegistry::instance()->snapshot();
+}
@@ -0,0 +1,95 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_METRICS_H
+#define ACCOUNTSETUP_PLUGIN_METRICS_H
+
+//libAccountSetup
+#include "provider-plugin-proxy.h"
+
+//Qt
+#include <QAtomicInt>
+#include <QString>
+#include <QVariantMap>
+
+namespace AccountSetup {
+
+/*
+ * Distribution of non-negative values in power-of-two buckets: bucket 0
+ * counts the zeroes, and bucket n the values in [2^(n-1), 2^n). Adding a
+ * value takes a couple of atomic increments, and no lock; a snapshot taken
+ * while values are being added might miss some of them.
+ */
+class PluginHistogram
+{
+public:
+    enum { BucketCount = 32 };
+
+    PluginHistogram();
+
+    void add(qint64 value);
+
+    /* count, max, p50, p90, p99 and the non-empty buckets; percentiles
+     * are the upper bound of their bucket, at most the max */
+    QVariantMap snapshot() const;
+
+private:
+    qint64 percentile(int count, int percent) const;
+
+    QAtomicInt m_buckets[BucketCount];
+    QAtomicInt m_count;
+    QAtomicInt m_max;
+};
+
+struct PluginMetricsEntry;
+
+/*
+ * Counters and histograms of the plugin launches, kept for the whole
+ * process: for all of them, for each provider and for each plugin. A
+ * session binds its recorder to the provider and to the plugin once, and
+ * from then on records without taking any lock.
+ */
+class PluginMetrics
+{
+public:
+    PluginMetrics();
+
+    void setProvider(const QString &providerName);
+    void setPlugin(const QString &pluginName);
+
+    void launched();
+    /* durations in milliseconds, sizes in bytes */
+    void finished(ProviderPluginProxy::Error error, bool failedToStart,
+                  qint64 queueTime, qint64 duration, qint64 payloadSize);
+
+    static QVariantMap snapshot();
+
+private:
+    enum { Total = 0, Provider, Plugin, EntryCount };
+
+    PluginMetricsEntry *m_entries[EntryCount];
+    bool m_launched;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_METRICS_H
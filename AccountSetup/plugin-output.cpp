@@ -0,0 +1,123 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-output.h"
+
+#include <string.h>
+
+using namespace AccountSetup;
+
+PluginOutputBuffer::PluginOutputBuffer():
+    m_start(0),
+    m_size(0),
+    m_total(0)
+{
+}
+
+void PluginOutputBuffer::setCapacity(int capacity)
+{
+    QByteArray kept = last(capacity);
+    m_data = QByteArray(qMax(capacity, 0), '\0');
+    m_start = 0;
+    m_size = 0;
+    if (!kept.isEmpty()) {
+        memcpy(m_data.data(), kept.constData(), kept.size());
+        m_size = kept.size();
+    }
+}
+
+void PluginOutputBuffer::append(const char *data, int length)
+{
+    m_total += length;
+
+    int capacity = m_data.size();
+    if (capacity == 0 || length <= 0)
+        return;
+
+    /* only the tail of a chunk larger than the buffer survives */
+    if (length >= capacity) {
+        memcpy(m_data.data(), data + length - capacity, capacity);
+        m_start = 0;
+        m_size = capacity;
+        return;
+    }
+
+    int end = (m_start + m_size) % capacity;
+    int first = qMin(length, capacity - end);
+    memcpy(m_data.data() + end, data, first);
+    memcpy(m_data.data(), data + first, length - first);
+
+    m_size += length;
+    if (m_size > capacity) {
+        m_start = (m_start + m_size - capacity) % capacity;
+        m_size = capacity;
+    }
+}
+
+QByteArray PluginOutputBuffer::last(int maxBytes) const
+{
+    int length = maxBytes < 0 ? m_size : qMin(maxBytes, m_size);
+    if (length <= 0)
+        return QByteArray();
+
+    int capacity = m_data.size();
+    int start = (m_start + m_size - length) % capacity;
+    int first = qMin(length, capacity - start);
+
+    QByteArray bytes(length, '\0');
+    memcpy(bytes.data(), m_data.constData() + start, first);
+    memcpy(bytes.data() + first, m_data.constData(), length - first);
+    return bytes;
+}
+
+PluginOutputLimiter::PluginOutputLimiter():
+    m_rate(0),
+    m_tokens(0),
+    m_dropped(0)
+{
+}
+
+void PluginOutputLimiter::setRate(int bytesPerSecond)
+{
+    m_rate = qMax(bytesPerSecond, 0);
+    m_tokens = qint64(m_rate) * 1000;
+    m_timer.start();
+}
+
+bool PluginOutputLimiter::allow(int bytes)
+{
+    if (m_rate == 0)
+        return true;
+
+    /* Tokens are in thousandths of a byte, so that frequent small writes
+     * don't lose the fractions. A chunk larger than the bucket goes
+     * through when the bucket is full, and leaves a debt. */
+    qint64 elapsed = m_timer.restart();
+    m_tokens = qMin(qint64(m_rate) * 1000, m_tokens + elapsed * m_rate);
+    if (m_tokens < qint64(qMin(bytes, m_rate)) * 1000) {
+        m_dropped += bytes;
+        return false;
+    }
+
+    m_tokens -= qint64(bytes) * 1000;
+    return true;
+}
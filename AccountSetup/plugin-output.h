@@ -0,0 +1,81 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_OUTPUT_H
+#define ACCOUNTSETUP_PLUGIN_OUTPUT_H
+
+//Qt
+#include <QByteArray>
+#include <QElapsedTimer>
+
+namespace AccountSetup {
+
+/*
+ * Keeps the last bytes written by a plugin process; older bytes are
+ * overwritten, so that a chatty plugin costs no more than the capacity.
+ */
+class PluginOutputBuffer
+{
+public:
+    PluginOutputBuffer();
+
+    void setCapacity(int capacity);
+    int capacity() const { return m_data.size(); }
+
+    void append(const char *data, int length);
+    QByteArray last(int maxBytes) const;
+
+    /* everything written, including what has been overwritten */
+    qint64 totalBytes() const { return m_total; }
+
+private:
+    QByteArray m_data;
+    int m_start;
+    int m_size;
+    qint64 m_total;
+};
+
+/*
+ * Token bucket limiting how much output goes to the log sink; up to one
+ * second worth of output can be let through at once.
+ */
+class PluginOutputLimiter
+{
+public:
+    PluginOutputLimiter();
+
+    /* 0 means no limit */
+    void setRate(int bytesPerSecond);
+    bool allow(int bytes);
+
+    qint64 droppedBytes() const { return m_dropped; }
+
+private:
+    int m_rate;
+    qint64 m_tokens;
+    qint64 m_dropped;
+    QElapsedTimer m_timer;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_OUTPUT_H
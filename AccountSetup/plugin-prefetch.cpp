@@ -0,0 +1,237 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-prefetch.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QLibraryInfo>
+
+#include <elf.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace AccountSetup;
+
+/* plugins don't need that many libraries; this stops runaway lookups */
+static const int maxPrefetchedFiles = 256;
+
+namespace {
+
+/* Reads the dynamic section of a mapped ELF file of either class; any
+ * offset is checked against the size of the file. */
+template <typename Ehdr, typename Phdr, typename Dyn>
+bool parseDynamic(const uchar *data, size_t size, QStringList &needed,
+                  QStringList &searchPath)
+{
+    if (size < sizeof(Ehdr))
+        return false;
+    const Ehdr *header = reinterpret_cast<const Ehdr *>(data);
+    if (header->e_phentsize != sizeof(Phdr) ||
+        header->e_phoff > size ||
+        size - header->e_phoff < size_t(header->e_phnum) * sizeof(Phdr))
+        return false;
+
+    const Phdr *phdrs = reinterpret_cast<const Phdr *>(data + header->e_phoff);
+    const Phdr *dynamic = 0;
+    for (int i = 0; i < header->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_DYNAMIC)
+            dynamic = &phdrs[i];
+    }
+    if (dynamic == 0 || dynamic->p_offset > size ||
+        size - dynamic->p_offset < dynamic->p_filesz)
+        return false;
+
+    const Dyn *entries = reinterpret_cast<const Dyn *>(data + dynamic->p_offset);
+    size_t count = dynamic->p_filesz / sizeof(Dyn);
+
+    /* DT_STRTAB is an address: find the file offset through the loaded
+     * segments */
+    quint64 stringTable = 0;
+    for (size_t i = 0; i < count && entries[i].d_tag != DT_NULL; i++) {
+        if (entries[i].d_tag == DT_STRTAB)
+            stringTable = entries[i].d_un.d_ptr;
+    }
+
+    quint64 stringOffset = 0;
+    quint64 stringSize = 0;
+    bool found = false;
+    for (int i = 0; i < header->e_phnum && !found; i++) {
+        const Phdr &phdr = phdrs[i];
+        if (phdr.p_type == PT_LOAD && stringTable >= phdr.p_vaddr &&
+            stringTable < phdr.p_vaddr + phdr.p_filesz) {
+            stringOffset = phdr.p_offset + (stringTable - phdr.p_vaddr);
+            stringSize = phdr.p_filesz - (stringTable - phdr.p_vaddr);
+            found = true;
+        }
+    }
+    if (!found || stringOffset >= size)
+        return false;
+    stringSize = qMin(stringSize, quint64(size - stringOffset));
+    const char *strings = reinterpret_cast<const char *>(data + stringOffset);
+
+    for (size_t i = 0; i < count && entries[i].d_tag != DT_NULL; i++) {
+        quint64 offset = entries[i].d_un.d_val;
+        if (offset >= stringSize)
+            continue;
+
+        const char *string = strings + offset;
+        size_t length = strnlen(string, stringSize - offset);
+        if (length == stringSize - offset)
+            continue;
+
+        QString value = QFile::decodeName(QByteArray(string, int(length)));
+        if (entries[i].d_tag == DT_NEEDED)
+            needed << value;
+        else if (entries[i].d_tag == DT_RPATH ||
+                 entries[i].d_tag == DT_RUNPATH)
+            searchPath += value.split(QLatin1Char(':'),
+                                      QString::SkipEmptyParts);
+    }
+    return true;
+}
+
+} // namespace
+
+bool PluginPrefetch::readDynamicSection(const QString &path,
+                                        QStringList &needed,
+                                        QStringList &searchPath)
+{
+    int fd = ::open(QFile::encodeName(path).constData(),
+                    O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    void *data = MAP_FAILED;
+    if (::fstat(fd, &info) == 0 && info.st_size > EI_NIDENT)
+        data = ::mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const uchar *bytes = static_cast<const uchar *>(data);
+    size_t size = info.st_size;
+    bool ok = false;
+    if (memcmp(bytes, ELFMAG, SELFMAG) == 0) {
+        if (bytes[EI_CLASS] == ELFCLASS64)
+            ok = parseDynamic<Elf64_Ehdr, Elf64_Phdr, Elf64_Dyn>(
+                bytes, size, needed, searchPath);
+        else if (bytes[EI_CLASS] == ELFCLASS32)
+            ok = parseDynamic<Elf32_Ehdr, Elf32_Phdr, Elf32_Dyn>(
+                bytes, size, needed, searchPath);
+    }
+
+    ::munmap(data, size);
+
+    /* $ORIGIN is the only substitution plugins are likely to use */
+    QString origin = QFileInfo(path).absolutePath();
+    for (int i = 0; i < searchPath.count(); i++) {
+        searchPath[i].replace(QLatin1String("${ORIGIN}"), origin);
+        searchPath[i].replace(QLatin1String("$ORIGIN"), origin);
+    }
+    return ok;
+}
+
+QString PluginPrefetch::findLibrary(const QString &name,
+                                    const QStringList &searchPath)
+{
+    if (name.contains(QLatin1Char('/')))
+        return QFileInfo(name).exists() ? name : QString();
+
+    foreach (const QString &dir, searchPath) {
+        QFileInfo info(dir, name);
+        if (info.exists())
+            return info.canonicalFilePath();
+    }
+    return QString();
+}
+
+bool PluginPrefetch::readAhead(const QString &path)
+{
+    int fd = ::open(QFile::encodeName(path).constData(),
+                    O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0;
+    if (ok) {
+        /* asynchronous: the pages are read while we go on */
+#ifdef POSIX_FADV_WILLNEED
+        ok = ::posix_fadvise(fd, 0, info.st_size, POSIX_FADV_WILLNEED) == 0;
+#else
+        ok = ::readahead(fd, 0, info.st_size) == 0;
+#endif
+    }
+    ::close(fd);
+    return ok;
+}
+
+void PluginPrefetch::prefetchTree(const QString &path,
+                                  QSet<QString> &visited, int &count)
+{
+    if (visited.contains(path) || visited.count() >= maxPrefetchedFiles)
+        return;
+    visited.insert(path);
+
+    if (readAhead(path))
+        count++;
+
+    QStringList needed;
+    QStringList searchPath;
+    if (!readDynamicSection(path, needed, searchPath))
+        return;
+
+    QByteArray libraryPath = qgetenv("LD_LIBRARY_PATH");
+    if (!libraryPath.isEmpty())
+        searchPath += QFile::decodeName(libraryPath).split(QLatin1Char(':'),
+                                           QString::SkipEmptyParts);
+    /* where the dependencies found so far are, which covers the
+     * multiarch directories */
+    foreach (const QString &file, visited)
+        searchPath << QFileInfo(file).absolutePath();
+    searchPath << QLibraryInfo::location(QLibraryInfo::LibrariesPath) <<
+        QLatin1String("/lib") << QLatin1String("/usr/lib");
+    searchPath.removeDuplicates();
+
+    foreach (const QString &name, needed) {
+        QString library = findLibrary(name, searchPath);
+        if (!library.isEmpty())
+            prefetchTree(library, visited, count);
+    }
+}
+
+int PluginPrefetch::prefetch(const QString &path)
+{
+    if (path.isEmpty())
+        return 0;
+
+    QSet<QString> visited;
+    int count = 0;
+    prefetchTree(path, visited, count);
+    return count;
+}
@@ -0,0 +1,59 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_PREFETCH_H
+#define ACCOUNTSETUP_PLUGIN_PREFETCH_H
+
+//Qt
+#include <QSet>
+#include <QStringList>
+
+namespace AccountSetup {
+
+/*
+ * Brings a plugin executable and the shared libraries it needs into the
+ * page cache, so that starting it doesn't wait for the disk. Libraries are
+ * found by reading the DT_NEEDED entries of the ELF files, and looking for
+ * them in the usual places; anything which cannot be found is skipped.
+ */
+class PluginPrefetch
+{
+public:
+    /* returns the number of files read ahead */
+    static int prefetch(const QString &path);
+
+    /* the names in the DT_NEEDED entries, and the RPATH or RUNPATH
+     * directories, of an ELF file */
+    static bool readDynamicSection(const QString &path, QStringList &needed,
+                                   QStringList &searchPath);
+
+private:
+    static QString findLibrary(const QString &name,
+                               const QStringList &searchPath);
+    static bool readAhead(const QString &path);
+    static void prefetchTree(const QString &path, QSet<QString> &visited,
+                             int &count);
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_PREFETCH_H
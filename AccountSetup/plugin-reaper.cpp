@@ -0,0 +1,112 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-reaper.h"
+#include "plugin-launcher.h"
+
+#include <QDebug>
+
+using namespace AccountSetup;
+
+PluginReaper::PluginReaper():
+    QObject(0)
+{
+}
+
+PluginReaper *PluginReaper::instance()
+{
+    /* never destroyed: processes can outlive all the proxies */
+    static PluginReaper *reaper = new PluginReaper();
+    return reaper;
+}
+
+void PluginReaper::reap(PluginLauncher *process, int timeout)
+{
+    process->disconnect();
+    process->setParent(this);
+
+    if (process->state() == QProcess::NotRunning) {
+        process->deleteLater();
+        return;
+    }
+
+    /* the launcher reaps the child when it sees it exit, without blocking */
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onFinished()));
+    connect(process, SIGNAL(error(QProcess::ProcessError)),
+            this, SLOT(onFinished()));
+
+    Entry entry;
+    entry.process = process;
+    entry.timer = new QTimer(this);
+    entry.timer->setSingleShot(true);
+    entry.terminated = false;
+    connect(entry.timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+
+    if (timeout > 0) {
+        entry.timer->start(timeout);
+    } else {
+        process->kill();
+        entry.terminated = true;
+    }
+    m_processes.append(entry);
+}
+
+void PluginReaper::onFinished()
+{
+    PluginLauncher *process = qobject_cast<PluginLauncher *>(sender());
+    if (process == 0 || process->state() != QProcess::NotRunning)
+        return;
+
+    for (int i = 0; i < m_processes.count(); i++) {
+        if (m_processes[i].process == process) {
+            delete m_processes[i].timer;
+            m_processes.removeAt(i);
+            break;
+        }
+    }
+
+    process->disconnect(this);
+    process->deleteLater();
+}
+
+void PluginReaper::onTimeout()
+{
+    QTimer *timer = qobject_cast<QTimer *>(sender());
+
+    for (int i = 0; i < m_processes.count(); i++) {
+        Entry &entry = m_processes[i];
+        if (entry.timer != timer)
+            continue;
+
+        if (!entry.terminated) {
+            qWarning() << "Plugin process not exiting, terminating it";
+            entry.process->terminate();
+            entry.terminated = true;
+            entry.timer->start();
+        } else {
+            qWarning() << "Plugin process not terminating, killing it";
+            entry.process->kill();
+        }
+        break;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_REAPER_H
+#define ACCOUNTSETUP_PLUGIN_REAPER_H
+
+//Qt
+#include <QObject>
+#include <QProcess>
+#include <QTimer>
+
+namespace AccountSetup {
+
+class PluginLauncher;
+
+/*
+ * Takes over plugin processes which are no longer needed, and deletes them
+ * once they have exited, so that nobody has to block waiting for them.
+ * Processes which don't exit in time get SIGTERM, and then SIGKILL.
+ */
+class PluginReaper: public QObject
+{
+    Q_OBJECT
+
+public:
+    static PluginReaper *instance();
+
+    /* With a timeout of 0, the process is killed right away. */
+    void reap(PluginLauncher *process, int timeout = 0);
+
+    int count() const { return m_processes.count(); }
+
+private Q_SLOTS:
+    void onFinished();
+    void onTimeout();
+
+private:
+    PluginReaper();
+
+    struct Entry {
+        PluginLauncher *process;
+        QTimer *timer;
+        bool terminated;
+    };
+    QList<Entry> m_processes;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_REAPER_H
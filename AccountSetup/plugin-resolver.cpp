@@ -0,0 +1,301 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "plugin-resolver.h"
+#include "plugin-index.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QThread>
+#include <QXmlStreamReader>
+
+#include <glib.h>
+#include <libaccounts-glib/ag-provider.h>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+PluginResolver::PluginResolver():
+    QObject(0),
+    watcher(new QFileSystemWatcher(this)),
+    index(new PluginIndex)
+{
+    connect(watcher, SIGNAL(directoryChanged(const QString &)),
+            this, SLOT(onDirectoryChanged(const QString &)));
+
+    QString indexFileName = PluginIndex::defaultFileName();
+    if (!index->open(indexFileName))
+        return;
+
+    /* built for other provider directories, e.g. another AG_PROVIDERS */
+    if (index->isStale() ||
+        index->providerDirectories() != providerDirectories()) {
+        qWarning() << "Plugin index is out of date:" << indexFileName;
+        index->close();
+        return;
+    }
+
+    /* missing directories can't be watched, but they can be created */
+    foreach (QString dir, index->watchedDirectories()) {
+        QString watched = watchableDirectory(dir);
+        if (!indexWatches.contains(watched))
+            indexWatches << watched;
+    }
+    watcher->addPaths(indexWatches);
+}
+
+PluginResolver::~PluginResolver()
+{
+    delete index;
+}
+
+PluginResolver *PluginResolver::instance()
+{
+    /* never destroyed: the cache is needed until the very end */
+    static PluginResolver *resolver = new PluginResolver();
+    return resolver;
+}
+
+QStringList PluginResolver::providerDirectories()
+{
+    /* the same directories as libaccounts, in its lookup order */
+    QByteArray envDir = qgetenv("AG_PROVIDERS");
+    if (!envDir.isEmpty())
+        return QStringList() << QFile::decodeName(envDir);
+
+    QLatin1String subDir("/accounts/providers");
+    QStringList providerDirs;
+    providerDirs << QFile::decodeName(g_get_user_data_dir()) + subDir;
+    for (const gchar * const *dir = g_get_system_data_dirs(); *dir != 0;
+         dir++)
+        providerDirs << QFile::decodeName(*dir) + subDir;
+#ifdef PROVIDER_FILES_DIR
+    QString buildDir = QString::fromLatin1(PROVIDER_FILES_DIR);
+    if (!providerDirs.contains(buildDir))
+        providerDirs << buildDir;
+#endif
+    return providerDirs;
+}
+
+QString PluginResolver::watchableDirectory(const QString &path)
+{
+    /* creating a missing directory changes the closest one which exists */
+    QDir dir(path);
+    while (!dir.exists() && !dir.isRoot()) {
+        if (!dir.cdUp())
+            break;
+    }
+    return dir.absolutePath();
+}
+
+static bool readPluginElement(const QByteArray &contents, QString &pluginName,
+                              QString &pluginMode)
+{
+    /* Only the <plugin> child of the root element is interesting: stop as
+     * soon as it's found. */
+    QXmlStreamReader xml(contents);
+    int depth = 0;
+    while (!xml.atEnd()) {
+        QXmlStreamReader::TokenType token = xml.readNext();
+        if (token == QXmlStreamReader::StartElement) {
+            depth++;
+            if (depth == 2 && xml.name() == QLatin1String("plugin")) {
+                pluginMode = xml.attributes().value(QLatin1String("mode")).
+                    toString();
+                pluginName = xml.readElementText();
+                return !xml.hasError();
+            }
+        } else if (token == QXmlStreamReader::EndElement) {
+            depth--;
+        }
+    }
+
+    pluginName.clear();
+    pluginMode.clear();
+    return !xml.hasError();
+}
+
+PluginLocation PluginResolver::scan(Provider provider,
+                                    const QStringList &pluginDirs)
+{
+    static const char pluginNamePattern[] = "%1plugin";
+    static const char libraryNamePattern[] = "lib%1plugin.so";
+    bool pluginTagExists = true;
+    PluginLocation location;
+
+    QString pluginName;
+    QString pluginMode;
+    /* the file libaccounts loaded the provider from, as it read it */
+    const gchar *contents = 0;
+    if (provider.provider() != 0)
+        ag_provider_get_file_contents(provider.provider(), &contents);
+    if (contents != 0 &&
+        !readPluginElement(QByteArray::fromRawData(contents, qstrlen(contents)),
+                           pluginName, pluginMode))
+        qWarning() << "Invalid provider file for" << provider.name();
+
+    if (pluginName.isEmpty()) {
+        pluginName = provider.name();
+        pluginTagExists = false;
+    }
+
+    QStringList pluginFileNames;
+    pluginFileNames << QString::fromLatin1(pluginNamePattern).arg(pluginName);
+
+    /* If a plugin for the specified name cannot be found and
+     * the plugin is not specified in the provider file, fallback to
+     * "genericplugin"
+     */
+    if (!pluginTagExists) {
+        pluginFileNames << QString::fromLatin1(pluginNamePattern).
+            arg(QLatin1String("generic"));
+    }
+
+    /* <plugin mode="in-process"> declares that the plugin is also built as
+     * a library, which can be loaded by the caller */
+    if (pluginTagExists && pluginMode == QLatin1String("in-process")) {
+        QString name = QString::fromLatin1(libraryNamePattern).arg(pluginName);
+        foreach (QString pluginDir, pluginDirs) {
+            QFileInfo libraryFileInfo(pluginDir, name);
+
+            if (libraryFileInfo.exists()) {
+                location.libraryPath = libraryFileInfo.canonicalFilePath();
+                break;
+            }
+        }
+    }
+
+    foreach (QString name, pluginFileNames) {
+        foreach (QString pluginDir, pluginDirs) {
+            QFileInfo pluginFileInfo(pluginDir, name);
+
+            if (pluginFileInfo.exists()) {
+                location.path = pluginFileInfo.canonicalFilePath();
+                location.fileName = name;
+                return location;
+            }
+        }
+    }
+
+    if (!location.libraryPath.isEmpty())
+        location.fileName = QFileInfo(location.libraryPath).fileName();
+    return location;
+}
+
+PluginLocation PluginResolver::resolve(Provider provider,
+                                       const QStringList &pluginDirs)
+{
+    QMutexLocker locker(&mutex);
+
+    if (index->isOpen() && pluginDirs == index->pluginDirectories()) {
+        PluginLocation location;
+        if (index->lookup(provider.name(), location))
+            return location;
+    }
+
+    QString key = provider.name() + QLatin1Char('\n') +
+        pluginDirs.join(QLatin1String("\n"));
+    QHash<QString, CacheEntry>::const_iterator i = cache.constFind(key);
+    if (i != cache.constEnd())
+        return i->location;
+    i = pendingEntries.constFind(key);
+    if (i != pendingEntries.constEnd())
+        return i->location;
+    locker.unlock();
+
+    CacheEntry entry;
+    entry.location = scan(provider, pluginDirs);
+
+    /* a provider file added to any of the directories could shadow the
+     * one which was read */
+    entry.watchedDirs = pluginDirs;
+    foreach (QString providerDir, providerDirectories()) {
+        QString dir = watchableDirectory(providerDir);
+        if (!entry.watchedDirs.contains(dir))
+            entry.watchedDirs << dir;
+    }
+
+    /* A directory which doesn't exist cannot be watched, and it might
+     * appear later with a plugin in it: don't cache the result. */
+    foreach (QString dir, entry.watchedDirs) {
+        if (!QFileInfo(dir).isDir())
+            return entry.location;
+    }
+
+    locker.relock();
+    if (QThread::currentThread() != thread()) {
+        /* the watcher can only be used from its own thread: the entry is
+         * served from here until the watches are in place */
+        bool scheduled = !pendingEntries.isEmpty();
+        pendingEntries.insert(key, entry);
+        if (!scheduled)
+            QMetaObject::invokeMethod(this, "onEntriesPending",
+                                      Qt::QueuedConnection);
+        return entry.location;
+    }
+
+    addEntry(key, entry);
+    return entry.location;
+}
+
+void PluginResolver::addEntry(const QString &key, const CacheEntry &entry)
+{
+    foreach (QString dir, entry.watchedDirs) {
+        if (!watcher->directories().contains(dir))
+            watcher->addPath(dir);
+    }
+    cache.insert(key, entry);
+}
+
+void PluginResolver::onEntriesPending()
+{
+    QMutexLocker locker(&mutex);
+
+    QHash<QString, CacheEntry>::const_iterator i;
+    for (i = pendingEntries.constBegin(); i != pendingEntries.constEnd(); ++i)
+        addEntry(i.key(), i.value());
+    pendingEntries.clear();
+}
+
+void PluginResolver::onDirectoryChanged(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+
+    /* the index is stale now: fall back to scanning the directories */
+    if (index->isOpen() && indexWatches.contains(path))
+        index->close();
+
+    QHash<QString, CacheEntry>::iterator i = cache.begin();
+    while (i != cache.end()) {
+        if (i->watchedDirs.contains(path))
+            i = cache.erase(i);
+        else
+            ++i;
+    }
+
+    /* not watched yet, but scanned before the change was noticed */
+    pendingEntries.clear();
+}
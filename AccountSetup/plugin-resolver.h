@@ -0,0 +1,108 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTSETUP_PLUGIN_RESOLVER_H
+#define ACCOUNTSETUP_PLUGIN_RESOLVER_H
+
+//Accounts
+#include <Accounts/Provider>
+
+//Qt
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QMutex>
+#include <QObject>
+#include <QStringList>
+
+namespace AccountSetup {
+
+class PluginIndex;
+
+/* Location of a plugin executable, and of its shared library if the
+ * provider declares that the plugin can run in-process; empty if no plugin
+ * could be found */
+struct PluginLocation
+{
+    bool isValid() const { return !path.isEmpty() || !libraryPath.isEmpty(); }
+
+    QString path;
+    QString fileName;
+    QString libraryPath;
+};
+
+/*
+ * Maps providers to their plugin executables. The prebuilt plugin index is
+ * used when it's up to date and covers the requested plugin directories;
+ * other results are cached per provider and list of plugin directories, and
+ * dropped as soon as any of the directories involved changes.
+ * resolve() can be called from any thread.
+ */
+class PluginResolver: public QObject
+{
+    Q_OBJECT
+
+public:
+    PluginResolver();
+    ~PluginResolver();
+
+    static PluginResolver *instance();
+
+    PluginLocation resolve(Accounts::Provider provider,
+                           const QStringList &pluginDirs);
+
+    /* Uncached resolution */
+    static PluginLocation scan(Accounts::Provider provider,
+                               const QStringList &pluginDirs);
+    /* Where libaccounts looks for provider files, whether they exist or
+     * not */
+    static QStringList providerDirectories();
+    /* The directory itself, or its closest ancestor if it doesn't exist */
+    static QString watchableDirectory(const QString &path);
+
+private Q_SLOTS:
+    void onDirectoryChanged(const QString &path);
+    void onEntriesPending();
+
+private:
+    struct CacheEntry
+    {
+        PluginLocation location;
+        QStringList watchedDirs;
+    };
+
+    void addEntry(const QString &key, const CacheEntry &entry);
+
+    QMutex mutex;
+    QFileSystemWatcher *watcher;
+    PluginIndex *index;
+    /* the directories of the index, or their closest existing ancestors */
+    QStringList indexWatches;
+    QHash<QString, CacheEntry> cache;
+    /* resolved in other threads, waiting for their directories to be
+     * watched */
+    QHash<QString, CacheEntry> pendingEntries;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_RESOLVER_H
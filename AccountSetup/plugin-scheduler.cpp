@@ -0,0 +1,230 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "plugin-scheduler.h"
+#include "provider-plugin-session-priv.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QMetaObject>
+#include <QMutexLocker>
+
+using namespace AccountSetup;
+
+/* what a plugin which has never run is assumed to need */
+static const qint64 defaultMemoryEstimate = 32 * 1024 * 1024;
+
+PluginScheduler::PluginScheduler():
+    m_maxRunning(0),
+    m_memoryBudget(0),
+    m_runningMemory(0)
+{
+}
+
+PluginScheduler *PluginScheduler::instance()
+{
+    /* never destroyed: sessions can release their slot until the end */
+    static PluginScheduler *scheduler = new PluginScheduler();
+    return scheduler;
+}
+
+void PluginScheduler::setMaxRunning(int count)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxRunning = qMax(count, 0);
+    dispatch();
+}
+
+int PluginScheduler::maxRunning() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxRunning;
+}
+
+void PluginScheduler::setMemoryBudget(qint64 bytes)
+{
+    QMutexLocker locker(&m_mutex);
+    m_memoryBudget = qMax(bytes, qint64(0));
+    dispatch();
+}
+
+qint64 PluginScheduler::memoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_memoryBudget;
+}
+
+qint64 PluginScheduler::memoryEstimate(const QString &pluginName) const
+{
+    return m_memoryUsage.value(pluginName, defaultMemoryEstimate);
+}
+
+bool PluginScheduler::fits(qint64 memory) const
+{
+    if (m_maxRunning > 0 && m_running.count() >= m_maxRunning)
+        return false;
+
+    /* a plugin bigger than the budget still runs, alone */
+    return m_memoryBudget <= 0 || m_running.isEmpty() ||
+        m_runningMemory + memory <= m_memoryBudget;
+}
+
+bool PluginScheduler::submit(ProviderPluginSessionPrivate *session,
+                             ProviderPluginProxy::Priority priority,
+                             const void *owner, const QString &pluginName)
+{
+    QMutexLocker locker(&m_mutex);
+
+    Ticket ticket;
+    ticket.session = session;
+    ticket.memory = memoryEstimate(pluginName);
+
+    /* nobody jumps the queue */
+    bool waiting = false;
+    for (int i = 0; i <= priority; i++)
+        waiting = waiting || !m_queues[i].isEmpty();
+
+    if (!waiting && fits(ticket.memory)) {
+        m_running.insert(session, ticket.memory);
+        m_runningMemory += ticket.memory;
+        return true;
+    }
+
+    QList<OwnerQueue> &queues = m_queues[priority];
+    QList<OwnerQueue>::iterator i;
+    for (i = queues.begin(); i != queues.end(); ++i) {
+        if (i->owner == owner) {
+            i->tickets.append(ticket);
+            return false;
+        }
+    }
+
+    OwnerQueue queue;
+    queue.owner = owner;
+    queue.tickets.append(ticket);
+    queues.append(queue);
+    return false;
+}
+
+void PluginScheduler::release(ProviderPluginSessionPrivate *session)
+{
+    QMutexLocker locker(&m_mutex);
+
+    QHash<ProviderPluginSessionPrivate*, qint64>::iterator running =
+        m_running.find(session);
+    if (running != m_running.end()) {
+        m_runningMemory -= running.value();
+        m_running.erase(running);
+        dispatch();
+        return;
+    }
+
+    for (int p = 0; p < PriorityCount; p++) {
+        QList<OwnerQueue> &queues = m_queues[p];
+        for (int i = 0; i < queues.count(); i++) {
+            QList<Ticket> &tickets = queues[i].tickets;
+            for (int t = 0; t < tickets.count(); t++) {
+                if (tickets[t].session != session)
+                    continue;
+                tickets.removeAt(t);
+                if (tickets.isEmpty())
+                    queues.removeAt(i);
+                dispatch();
+                return;
+            }
+        }
+    }
+}
+
+void PluginScheduler::dispatch()
+{
+    for (int p = 0; p < PriorityCount; p++) {
+        QList<OwnerQueue> &queues = m_queues[p];
+        while (!queues.isEmpty()) {
+            /* the head of the queue waits for room, whatever comes after */
+            OwnerQueue queue = queues.takeFirst();
+            Ticket ticket = queue.tickets.first();
+            if (!fits(ticket.memory)) {
+                queues.prepend(queue);
+                return;
+            }
+
+            queue.tickets.removeFirst();
+            if (!queue.tickets.isEmpty())
+                queues.append(queue);
+
+            m_running.insert(ticket.session, ticket.memory);
+            m_runningMemory += ticket.memory;
+            QMetaObject::invokeMethod(ticket.session, "onLaunchGranted",
+                                      Qt::QueuedConnection);
+        }
+    }
+}
+
+void PluginScheduler::recordMemoryUsage(const QString &pluginName,
+                                        qint64 bytes)
+{
+    if (bytes <= 0)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    qint64 &usage = m_memoryUsage[pluginName];
+    usage = qMax(usage, bytes);
+}
+
+qint64 PluginScheduler::peakMemory(qint64 pid)
+{
+    if (pid <= 0)
+        return 0;
+
+    QFile status(QString::fromLatin1("/proc/%1/status").arg(pid));
+    if (!status.open(QIODevice::ReadOnly))
+        return 0;
+
+    /* "VmHWM:     1234 kB" */
+    QByteArray line;
+    while (!(line = status.readLine()).isEmpty()) {
+        if (!line.startsWith("VmHWM:"))
+            continue;
+        QByteArray value = line.mid(6).trimmed();
+        value.chop(3);
+        return value.trimmed().toLongLong() * 1024;
+    }
+    return 0;
+}
+
+int PluginScheduler::runningCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running.count();
+}
+
+int PluginScheduler::queuedCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    int count = 0;
+    for (int p = 0; p < PriorityCount; p++) {
+        foreach (const OwnerQueue &queue, m_queues[p])
+            count += queue.tickets.count();
+    }
+    return count;
+}
@@ -0,0 +1,106 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PLUGIN_SCHEDULER_H
+#define ACCOUNTSETUP_PLUGIN_SCHEDULER_H
+
+//libAccountSetup
+#include "provider-plugin-proxy.h"
+
+//Qt
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+
+namespace AccountSetup {
+
+class ProviderPluginSessionPrivate;
+
+/*
+ * Decides when the plugin processes of all the proxies are started, so
+ * that no more than a given number run at once, and that their memory
+ * stays within a budget. The memory a plugin needs is the peak seen in its
+ * previous runs, or a default guess until it has run once.
+ *
+ * Launches which cannot start wait in a queue for each priority; the
+ * interactive ones always go first. Within a priority, the proxies take
+ * turns, so that a long batch doesn't hold back the launches of another
+ * proxy. When its turn comes, a session is told from its own thread with
+ * a queued call to onLaunchGranted().
+ */
+class PluginScheduler
+{
+public:
+    static PluginScheduler *instance();
+
+    /* 0 means no limit, which is the default for both */
+    void setMaxRunning(int count);
+    int maxRunning() const;
+    void setMemoryBudget(qint64 bytes);
+    qint64 memoryBudget() const;
+
+    /* Returns true if the session can start right away; otherwise, it's
+     * queued. Either way, release() must follow. */
+    bool submit(ProviderPluginSessionPrivate *session,
+                ProviderPluginProxy::Priority priority,
+                const void *owner, const QString &pluginName);
+    /* for sessions which are done, or which have given up waiting */
+    void release(ProviderPluginSessionPrivate *session);
+
+    void recordMemoryUsage(const QString &pluginName, qint64 bytes);
+    /* the peak resident memory of a running process, in bytes */
+    static qint64 peakMemory(qint64 pid);
+
+    int runningCount() const;
+    int queuedCount() const;
+
+private:
+    PluginScheduler();
+
+    struct Ticket {
+        ProviderPluginSessionPrivate *session;
+        qint64 memory;
+    };
+    struct OwnerQueue {
+        const void *owner;
+        QList<Ticket> tickets;
+    };
+    enum { PriorityCount = ProviderPluginProxy::BackgroundPriority + 1 };
+
+    qint64 memoryEstimate(const QString &pluginName) const;
+    bool fits(qint64 memory) const;
+    void dispatch();
+
+    mutable QMutex m_mutex;
+    int m_maxRunning;
+    qint64 m_memoryBudget;
+    /* round robin order: the owner at the head is the next to go */
+    QList<OwnerQueue> m_queues[PriorityCount];
+    QHash<ProviderPluginSessionPrivate*, qint64> m_running;
+    qint64 m_runningMemory;
+    QHash<QString, qint64> m_memoryUsage;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_SCHEDULER_H
@@ -0,0 +1,66 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "plugin-trace.h"
+
+#include <QDataStream>
+
+#include <time.h>
+
+using namespace AccountSetup;
+
+qint64 PluginTrace::timestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+}
+
+QByteArray PluginTrace::encode(qint64 pid,
+                               const QList<PluginTracePoint> &points)
+{
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << pid << quint32(points.count());
+    foreach (const PluginTracePoint &point, points)
+        stream << point.first << point.second;
+    return payload;
+}
+
+bool PluginTrace::decode(const QByteArray &payload, qint64 &pid,
+                         QList<PluginTracePoint> &points)
+{
+    QDataStream stream(payload);
+    quint32 count = 0;
+    stream >> pid >> count;
+
+    for (quint32 i = 0; i < count; i++) {
+        PluginTracePoint point;
+        stream >> point.first >> point.second;
+        if (stream.status() != QDataStream::Ok)
+            break;
+        points.append(point);
+    }
+
+    return stream.status() == QDataStream::Ok;
+}
@@ -0,0 +1,55 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTSETUP_PLUGIN_TRACE_H
+#define ACCOUNTSETUP_PLUGIN_TRACE_H
+
+//Qt
+#include <QByteArray>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+namespace AccountSetup {
+
+/*
+ * Phases of a plugin execution, recorded by the plugin and sent to the
+ * caller in Trace messages. Timestamps are in microseconds from the
+ * monotonic clock, which is the same for all the processes, so that the
+ * phases of both sides can be put on a single timeline.
+ */
+typedef QPair<QString, qint64> PluginTracePoint;
+
+class PluginTrace
+{
+public:
+    static qint64 timestamp();
+
+    static QByteArray encode(qint64 pid, const QList<PluginTracePoint> &points);
+    static bool decode(const QByteArray &payload, qint64 &pid,
+                       QList<PluginTracePoint> &points);
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PLUGIN_TRACE_H
@@ -0,0 +1,95 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_PRIV_H
+#define ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_PRIV_H
+
+//libAccountSetup
+#include "provider-plugin-batch.h"
+
+//Qt
+#include <QElapsedTimer>
+#include <QHash>
+#include <QPointer>
+#include <QSet>
+
+namespace AccountSetup {
+
+class ProviderPluginProxyPrivate;
+class ProviderPluginSession;
+
+struct ProviderPluginJob
+{
+    Accounts::Provider provider;
+    QStringList parameters;
+    QElapsedTimer timer;
+};
+
+class ProviderPluginBatchPrivate: public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(ProviderPluginBatch)
+
+public:
+    ProviderPluginBatchPrivate(ProviderPluginBatch *parent,
+                               ProviderPluginProxyPrivate *proxy):
+        q_ptr(parent),
+        proxy(proxy),
+        parallelism(4),
+        standbyEnabled(true),
+        started(false),
+        nextJob(0),
+        finishedJobs(0),
+        elapsed(0)
+    {
+    }
+    ~ProviderPluginBatchPrivate();
+
+    void startJobs();
+    void prestartJobs();
+    void finishJob(int index, ProviderPluginSession *session);
+    void checkFinished();
+    void stopStandbyPlugins();
+
+private Q_SLOTS:
+    void onSessionFinished();
+
+private:
+    mutable ProviderPluginBatch *q_ptr;
+    QPointer<ProviderPluginProxyPrivate> proxy;
+    int parallelism;
+    bool standbyEnabled;
+    bool started;
+    QList<ProviderPluginJob> jobs;
+    QList<ProviderPluginResult> results;
+    QHash<ProviderPluginSession *, int> runningJobs;
+    /* standby plugins started by the batch, by plugin path */
+    QSet<QString> standbyPlugins;
+    int nextJob;
+    int finishedJobs;
+    QElapsedTimer timer;
+    qint64 elapsed;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_PRIV_H
@@ -0,0 +1,251 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "provider-plugin-batch.h"
+#include "provider-plugin-batch-priv.h"
+#include "provider-plugin-proxy-priv.h"
+
+#include <QDebug>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+ProviderPluginResult::ProviderPluginResult():
+    m_finished(false),
+    m_error(ProviderPluginProxy::NoError),
+    m_createdAccountId(0),
+    m_elapsed(0),
+    m_queueTime(0)
+{
+}
+
+ProviderPluginBatchPrivate::~ProviderPluginBatchPrivate()
+{
+    stopStandbyPlugins();
+}
+
+void ProviderPluginBatchPrivate::startJobs()
+{
+    while (runningJobs.count() < parallelism && nextJob < jobs.count()) {
+        int index = nextJob++;
+        ProviderPluginJob &job = jobs[index];
+
+        job.timer.start();
+        ProviderPluginSession *session =
+            proxy->startProcess(job.provider, 0, results[index].m_serviceType,
+                                ProviderPluginProxy::BackgroundPriority,
+                                job.parameters);
+
+        /* a plugin which cannot be found fails right away */
+        if (!session->isRunning()) {
+            finishJob(index, session);
+            continue;
+        }
+
+        runningJobs.insert(session, index);
+        connect(session, SIGNAL(finished()), this, SLOT(onSessionFinished()));
+    }
+}
+
+void ProviderPluginBatchPrivate::prestartJobs()
+{
+    if (!standbyEnabled)
+        return;
+
+    /* The plugins for the jobs which will start next initialize while the
+     * current ones are running. Only one standby process is kept for each
+     * plugin, so jobs for the same provider share it in turn. */
+    int last = qMin(nextJob + parallelism, jobs.count());
+    for (int i = nextJob; i < last; i++) {
+        QString pluginPath;
+        if (proxy->startStandby(jobs[i].provider, &pluginPath) &&
+            !pluginPath.isEmpty())
+            standbyPlugins.insert(pluginPath);
+    }
+}
+
+void ProviderPluginBatchPrivate::finishJob(int index,
+                                           ProviderPluginSession *session)
+{
+    Q_Q(ProviderPluginBatch);
+
+    ProviderPluginResult &result = results[index];
+    result.m_finished = true;
+    result.m_error = session->error();
+    result.m_createdAccountId = session->createdAccountId();
+    result.m_exitData = session->exitData();
+    result.m_queueTime = session->queueTime();
+    result.m_elapsed = jobs[index].timer.elapsed() - result.m_queueTime;
+    finishedJobs++;
+
+    /* the results are copied: the session isn't needed anymore */
+    session->deleteLater();
+
+    emit q->jobFinished(index);
+}
+
+void ProviderPluginBatchPrivate::onSessionFinished()
+{
+    ProviderPluginSession *session =
+        qobject_cast<ProviderPluginSession*>(sender());
+    if (!runningJobs.contains(session))
+        return;
+
+    finishJob(runningJobs.take(session), session);
+
+    if (proxy != 0) {
+        startJobs();
+        prestartJobs();
+    }
+
+    checkFinished();
+}
+
+void ProviderPluginBatchPrivate::checkFinished()
+{
+    Q_Q(ProviderPluginBatch);
+
+    if (!started || finishedJobs < jobs.count())
+        return;
+
+    started = false;
+    elapsed = timer.elapsed();
+    stopStandbyPlugins();
+    emit q->finished();
+}
+
+void ProviderPluginBatchPrivate::stopStandbyPlugins()
+{
+    /* the ones which haven't been used are of no use anymore */
+    if (proxy != 0) {
+        foreach (const QString &pluginPath, standbyPlugins)
+            proxy->stopStandby(pluginPath);
+    }
+    standbyPlugins.clear();
+}
+
+ProviderPluginBatch::ProviderPluginBatch(ProviderPluginProxyPrivate *proxy,
+                                         QObject *parent):
+    QObject(parent),
+    d_ptr(new ProviderPluginBatchPrivate(this, proxy))
+{
+}
+
+ProviderPluginBatch::~ProviderPluginBatch()
+{
+    Q_D(ProviderPluginBatch);
+    delete d;
+}
+
+int ProviderPluginBatch::addJob(Accounts::Provider provider,
+                                const QString &serviceType,
+                                const QStringList &parameters)
+{
+    Q_D(ProviderPluginBatch);
+
+    if (d->started || d->finishedJobs > 0) {
+        qWarning() << "Batch already started";
+        return -1;
+    }
+
+    if (!provider.isValid()) {
+        qCritical() << " NULL pointer to provider";
+        return -1;
+    }
+
+    ProviderPluginJob job;
+    job.provider = provider;
+    job.parameters = parameters;
+    d->jobs.append(job);
+
+    ProviderPluginResult result;
+    result.m_providerName = provider.name();
+    result.m_serviceType = serviceType;
+    d->results.append(result);
+
+    return d->jobs.count() - 1;
+}
+
+int ProviderPluginBatch::jobCount() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->jobs.count();
+}
+
+void ProviderPluginBatch::setParallelism(int jobs)
+{
+    Q_D(ProviderPluginBatch);
+    d->parallelism = qMax(jobs, 1);
+}
+
+int ProviderPluginBatch::parallelism() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->parallelism;
+}
+
+void ProviderPluginBatch::setStandbyEnabled(bool enabled)
+{
+    Q_D(ProviderPluginBatch);
+    d->standbyEnabled = enabled;
+}
+
+bool ProviderPluginBatch::standbyEnabled() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->standbyEnabled;
+}
+
+void ProviderPluginBatch::start()
+{
+    Q_D(ProviderPluginBatch);
+
+    if (d->started || d->finishedJobs > 0 || d->proxy == 0)
+        return;
+
+    d->started = true;
+    d->timer.start();
+
+    d->startJobs();
+    d->prestartJobs();
+
+    /* all the jobs might have failed already */
+    d->checkFinished();
+}
+
+bool ProviderPluginBatch::isRunning() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->started;
+}
+
+QList<ProviderPluginResult> ProviderPluginBatch::results() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->results;
+}
+
+qint64 ProviderPluginBatch::elapsed() const
+{
+    Q_D(const ProviderPluginBatch);
+    return d->started ? d->timer.elapsed() : d->elapsed;
+}
@@ -0,0 +1,233 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+/*!
+ * @copyright Copyright (C) 2011 Nokia Corporation.
+ * @license LGPL
+ */
+
+#ifndef ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_H
+#define ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_H
+
+// libAccountSetup
+#include <AccountSetup/common.h>
+#include <AccountSetup/provider-plugin-proxy.h>
+
+// Accounts
+#include <Accounts/Provider>
+
+// Qt
+#include <QList>
+#include <QObject>
+#include <QStringList>
+#include <QVariant>
+
+namespace AccountSetup {
+
+class ProviderPluginBatchPrivate;
+
+/*!
+ * @class ProviderPluginResult
+ * @headerfile AccountSetup/provider-plugin-batch.h \
+ * AccountSetup/ProviderPluginBatch
+ * @brief The outcome of one job of a ProviderPluginBatch.
+ */
+class ACCOUNTSETUP_EXPORT ProviderPluginResult
+{
+public:
+    ProviderPluginResult();
+
+    /*!
+     * @return The name of the provider of the job.
+     */
+    QString providerName() const { return m_providerName; }
+
+    /*!
+     * @return The service type of the job.
+     */
+    QString serviceType() const { return m_serviceType; }
+
+    /*!
+     * @return Whether the job has been executed.
+     */
+    bool isFinished() const { return m_finished; }
+
+    /*!
+     * @return The error code of the plugin execution.
+     */
+    ProviderPluginProxy::Error error() const { return m_error; }
+
+    /*!
+     * @return Whether an account has been successfully created.
+     */
+    bool accountCreated() const { return m_createdAccountId != 0; }
+
+    /*!
+     * @return The account ID of the created account.
+     */
+    Accounts::AccountId createdAccountId() const
+        { return m_createdAccountId; }
+
+    /*!
+     * @return The extra data that the plugin returned when terminating.
+     */
+    QVariant exitData() const { return m_exitData; }
+
+    /*!
+     * @return The time from the launch of the plugin to its termination, in
+     * milliseconds.
+     */
+    qint64 elapsed() const { return m_elapsed; }
+
+    /*!
+     * @return How long the plugin waited for other plugins to finish
+     * before it could be launched, in milliseconds.
+     * @sa ProviderPluginProxy::setMaxRunningPlugins()
+     */
+    qint64 queueTime() const { return m_queueTime; }
+
+private:
+    friend class ProviderPluginBatchPrivate;
+    friend class ProviderPluginProxyPrivate;
+    friend class ProviderPluginSessionPrivate;
+    QString m_providerName;
+    QString m_serviceType;
+    bool m_finished;
+    ProviderPluginProxy::Error m_error;
+    Accounts::AccountId m_createdAccountId;
+    QVariant m_exitData;
+    qint64 m_elapsed;
+    qint64 m_queueTime;
+};
+
+/*!
+ * @class ProviderPluginBatch
+ * @headerfile AccountSetup/provider-plugin-batch.h \
+ * AccountSetup/ProviderPluginBatch
+ * @brief Runs account plugins for a list of providers.
+ *
+ * @details A batch is created with ProviderPluginProxy::createBatch(), and
+ * filled with jobs with addJob(); start() then runs the plugins to create
+ * the accounts, keeping up to parallelism() of them running at the same
+ * time. While the first jobs are running, the plugins for the next ones
+ * are started in standby mode, so that they are ready by the time they are
+ * needed.
+ *
+ * The jobFinished() signal is emitted as each job completes, and
+ * finished() when all of them have; the results can then be read with
+ * results().
+ */
+class ACCOUNTSETUP_EXPORT ProviderPluginBatch: public QObject
+{
+    Q_OBJECT
+
+public:
+    virtual ~ProviderPluginBatch();
+
+    /*!
+     * Adds a job to the batch; jobs are started in the order they are
+     * added. Jobs cannot be added once the batch has been started.
+     *
+     * @param provider The Accounts::Provider for the account to be created.
+     * @param serviceType The main service type the user is interested in, or
+     * empty string.
+     * @param parameters Additional parameters for the plugin, passed after
+     * the ones set on the ProviderPluginProxy.
+     *
+     * @return The index of the job, or -1 if it cannot be added.
+     */
+    int addJob(Accounts::Provider provider,
+               const QString &serviceType = QString(),
+               const QStringList &parameters = QStringList());
+
+    /*!
+     * @return The number of jobs in the batch.
+     */
+    int jobCount() const;
+
+    /*!
+     * Sets how many plugins can be running at the same time. The default
+     * is 4.
+     * @param jobs The maximum number of concurrent jobs.
+     */
+    void setParallelism(int jobs);
+
+    /*!
+     * @return The maximum number of concurrent jobs.
+     */
+    int parallelism() const;
+
+    /*!
+     * Enables or disables starting the plugins for the next jobs in standby
+     * mode. It's enabled by default.
+     * @param enabled Whether plugins should be started in advance.
+     */
+    void setStandbyEnabled(bool enabled);
+
+    /*!
+     * @return Whether plugins are started in advance.
+     */
+    bool standbyEnabled() const;
+
+    /*!
+     * Starts running the jobs.
+     */
+    void start();
+
+    /*!
+     * @return Whether the batch has been started and not finished yet.
+     */
+    bool isRunning() const;
+
+    /*!
+     * @return The results of the jobs, in the order of addJob().
+     */
+    QList<ProviderPluginResult> results() const;
+
+    /*!
+     * @return The time from start() to the completion of the last job, or
+     * until now if the batch is still running, in milliseconds.
+     */
+    qint64 elapsed() const;
+
+Q_SIGNALS:
+    /*!
+     * Emitted when a job has completed.
+     * @param index The index of the job, as returned by addJob().
+     */
+    void jobFinished(int index);
+
+    /*!
+     * Emitted when all the jobs have completed.
+     */
+    void finished();
+
+private:
+    friend class ProviderPluginProxy;
+    ProviderPluginBatch(ProviderPluginProxyPrivate *proxy, QObject *parent);
+
+    ProviderPluginBatchPrivate *d_ptr;
+    Q_DECLARE_PRIVATE(ProviderPluginBatch)
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PROVIDER_PLUGIN_BATCH_H
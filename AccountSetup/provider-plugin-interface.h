@@ -0,0 +1,82 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+/*!
+ * @copyright Copyright (C) 2011 Nokia Corporation.
+ * @license LGPL
+ */
+
+#ifndef ACCOUNTSETUP_PROVIDER_PLUGIN_INTERFACE_H
+#define ACCOUNTSETUP_PROVIDER_PLUGIN_INTERFACE_H
+
+// libAccountSetup
+#include <AccountSetup/common.h>
+#include <AccountSetup/provider-plugin-process.h>
+
+// Qt
+#include <QtPlugin>
+
+namespace AccountSetup {
+
+/*!
+ * @class ProviderPluginInterface
+ * @headerfile AccountSetup/provider-plugin-interface.h \
+ * AccountSetup/ProviderPluginInterface
+ * @brief Interface of the account plugins which can run in-process.
+ *
+ * @details Account plugins are normally executables, started by
+ * ProviderPluginProxy in a process of their own. Trusted plugins which
+ * don't have a UI can also be built as a shared library implementing this
+ * interface, named lib<plugin>plugin.so and installed next to the
+ * executable. The provider file declares it by setting the mode attribute
+ * of its plugin element:
+ *
+ * @code
+ * <plugin mode="in-process">example</plugin>
+ * @endcode
+ *
+ * If the caller has enabled in-process plugins, with
+ * ProviderPluginProxy::setInProcessPluginsEnabled(), the library is loaded
+ * with QPluginLoader and the plugin runs in the caller's main thread, using
+ * the caller's Accounts::Manager; otherwise, the executable is used.
+ */
+class ProviderPluginInterface
+{
+public:
+    virtual ~ProviderPluginInterface() {}
+
+    /*!
+     * Runs the plugin. The plugin uses the @a process object just like an
+     * executable plugin uses ProviderPluginProcess::instance(), and calls
+     * ProviderPluginProcess::quit() when done, after which the caller
+     * deletes the object. This method must not block: the plugin should
+     * rather do its work asynchronously.
+     * @param process The ProviderPluginProcess for this execution.
+     */
+    virtual void start(ProviderPluginProcess *process) = 0;
+};
+
+} // namespace
+
+Q_DECLARE_INTERFACE(AccountSetup::ProviderPluginInterface,
+                    "com.nokia.AccountSetup.ProviderPluginInterface/1.0")
+
+#endif // ACCOUNTSETUP_PROVIDER_PLUGIN_INTERFACE_H
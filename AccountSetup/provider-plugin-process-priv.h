@@ -24,6 +24,8 @@
 #define ACCOUNTSETUP_PROVIDER_PLUGIN_PROCESS_PRIV_H
 
 //libAccountSetup
+#include "plugin-launch.h"
+#include "plugin-trace.h"
 #include "provider-plugin-process.h"
 
 //Accounts
@@ -35,6 +37,8 @@
 
 namespace AccountSetup {
 
+class PluginChannel;
+
 class ProviderPluginProcessPrivate: public QObject
 {
     Q_OBJECT
@@ -44,10 +48,32 @@ public:
     ProviderPluginProcessPrivate(ProviderPluginProcess *parent);
     ~ProviderPluginProcessPrivate();
 
-    void sendResultToCaller();
+    void init();
+    void initHosted(Accounts::Manager *hostManager,
+                    const PluginLaunch &hostLaunch);
+
+    void waitForLaunch();
+    void applyLaunch();
+    void parseArguments(const QStringList &args);
+    Accounts::Account *loadAccount();
+    void openChannel();
+    void sendToCaller(int type, const QVariant &value);
+    Accounts::AccountId accountIdForCaller();
+    void sendResultToCaller(bool stayConnected = false);
+    bool canServe();
+    void becomeIdle();
+    bool sendSharedResult(const QByteArray &result);
+    void trace(const char *phase);
+    void flushTrace();
 
 public Q_SLOTS:
     void onSocketError(QLocalSocket::LocalSocketError errorStatus);
+    void onMessageReceived(int type, const QByteArray &payload);
+    void onChannelClosed();
+
+Q_SIGNALS:
+    /* messages for the caller, when the plugin runs inside it */
+    void hostMessage(int type, const QByteArray &payload);
 
 private:
     mutable ProviderPluginProcess *q_ptr;
@@ -55,13 +81,28 @@ private:
     WId windowId;
     Accounts::Manager *manager;
     Accounts::Account *account;
+    QString providerName;
+    Accounts::AccountId accountId;
     QString serviceType;
+    QStringList arguments;
+    QStringList baseArguments;
+    bool hosted;
     bool returnToApp;
     QString socketName;
+    int channelFd;
+    int descriptorFd;
+    PluginChannel *channel;
+    bool launched;
+    PluginLaunch launch;
+    QVariantMap parameters;
     bool goToAccountsPage;
     QVariant exitData;
     bool editExistingAccount;
     Accounts::AccountId existingAccountId;
+    bool tracing;
+    QList<PluginTracePoint> tracePoints;
+    bool serverMode;
+    bool idle;
 };
 
 } // namespace
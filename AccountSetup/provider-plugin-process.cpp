@@ -21,6 +21,7 @@
  */
 
 #include "provider-plugin-process-priv.h"
+#include "plugin-channel.h"
 
 #include <Accounts/Account>
 #include <Accounts/Manager>
@@ -31,25 +32,151 @@
 #include <QLocalSocket>
 #include <QVariant>
 
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
 using namespace AccountSetup;
 
 static ProviderPluginProcess *plugin_instance = 0;
 const int cancelId = -1;
+/* how long the caller can take to read the result, in milliseconds */
+static const int resultTimeout = 30000;
+/* larger results are passed in a shared buffer instead of being copied
+ * through the channel */
+static const int sharedResultThreshold = 64 * 1024;
 
 ProviderPluginProcessPrivate::ProviderPluginProcessPrivate(ProviderPluginProcess *parent):
     q_ptr(parent),
     setupType(Unset),
     windowId(0),
+    hosted(false),
+    channelFd(-1),
+    descriptorFd(-1),
+    channel(0),
+    launched(false),
     goToAccountsPage(false),
     exitData(),
     editExistingAccount(false),
-    existingAccountId(0)
+    existingAccountId(0),
+    tracing(false),
+    serverMode(false),
+    idle(false)
 {
     account = 0;
-    manager = new Accounts::Manager(this);
+    manager = 0;
+    accountId = 0;
+    trace("plugin-created");
+}
+
+void ProviderPluginProcessPrivate::init()
+{
+    /* only the channel is set up from the command line */
+    arguments = QCoreApplication::arguments();
+    baseArguments = arguments;
+    parseArguments(arguments);
+    serverMode = arguments.contains(QLatin1String("--server"));
+    openChannel();
+
+    bool standby = arguments.contains(QLatin1String("--standby"));
+    if (!standby && !arguments.contains(QLatin1String("--launch")))
+        return;
+
+    /* A plugin started in standby mode has done all its initialization at
+     * this point; the DB is opened while waiting, rather than after the
+     * launch. */
+    if (standby)
+        loadAccount();
+    waitForLaunch();
+    trace("launch-received");
+
+    /* The task of a plugin started for it is on the command line already,
+     * right after --launch; arguments() has it only once, at the end, as
+     * for the other plugins. */
+    if (!standby) {
+        int index = baseArguments.indexOf(QLatin1String("--launch")) + 1;
+        for (int i = 0; i < launch.arguments.count() &&
+             index < baseArguments.count(); i++)
+            baseArguments.removeAt(index);
+        arguments = baseArguments;
+    }
+    applyLaunch();
+    flushTrace();
+}
+
+void ProviderPluginProcessPrivate::initHosted(Accounts::Manager *hostManager,
+                                              const PluginLaunch &hostLaunch)
+{
+    /* the caller's manager is used, no need for another DB connection */
+    hosted = true;
+    manager = hostManager;
+    launch = hostLaunch;
+    applyLaunch();
+}
+
+void ProviderPluginProcessPrivate::applyLaunch()
+{
+    setupType = launch.setupType;
+    windowId = (WId)launch.windowId;
+    providerName = launch.providerName;
+    accountId = launch.accountId;
+    serviceType = launch.serviceType;
+    parameters = launch.parameters;
+    tracing = (launch.flags & PluginLaunch::Trace) != 0;
+    arguments += launch.arguments;
+}
+
+ProviderPluginProcessPrivate::~ProviderPluginProcessPrivate()
+{
+    /* In a plugin process, the account goes away with our own manager,
+     * which is deleted along with us. A hosted plugin gets its account
+     * from the caller's manager, which outlives us: the account is ours
+     * to delete, or it would stay around for as long as the caller. */
+    if (hosted)
+        delete account;
+}
+
+Accounts::Account *ProviderPluginProcessPrivate::loadAccount()
+{
+    /* The DB is only opened when needed, so that the plugin can show its
+     * UI first. */
+    if (manager == 0) {
+        manager = new Accounts::Manager(this);
+        trace("manager-ready");
+    }
+
+    if (account != 0)
+        return account;
+
+    if (setupType == CreateNew && !providerName.isEmpty())
+        account = manager->createAccount(providerName);
+    else if (setupType == EditExisting && accountId != 0)
+        account = manager->account(accountId);
+    else
+        return 0;
+
+    trace("account-loaded");
+    return account;
+}
+
+void ProviderPluginProcessPrivate::waitForLaunch()
+{
+    if (channel == 0) {
+        qWarning() << "Launch channel not established";
+        exit(EXIT_FAILURE);
+    }
+
+    while (!launched && channel->socket()->waitForReadyRead(-1))
+        ;
 
-    /* parse command line options */
-    QStringList args = QCoreApplication::arguments();
+    if (!launched) {
+        /* the caller doesn't need this plugin anymore */
+        exit(EXIT_SUCCESS);
+    }
+}
+
+void ProviderPluginProcessPrivate::parseArguments(const QStringList &args)
+{
     for (int i = 0; i < args.length(); ++i)
     {
         Q_ASSERT(args[i] != NULL);
@@ -59,9 +186,8 @@ ProviderPluginProcessPrivate::ProviderPluginProcessPrivate(ProviderPluginProcess
             setupType = CreateNew;
 
             i++;
-            if (i < args.length()) {
-                account = manager->createAccount(args[i]);
-            }
+            if (i < args.length())
+                providerName = args[i];
         }
         else if (args[i] == QLatin1String("--edit"))
         {
@@ -69,7 +195,7 @@ ProviderPluginProcessPrivate::ProviderPluginProcessPrivate(ProviderPluginProcess
 
             i++;
             if (i < args.length())
-                account = manager->account(args[i].toInt());
+                accountId = args[i].toInt();
         }
         else if (args[i] == QLatin1String("--windowId"))
         {
@@ -85,6 +211,22 @@ ProviderPluginProcessPrivate::ProviderPluginProcessPrivate(ProviderPluginProcess
                 socketName = args[i];
             Q_ASSERT(socketName != 0);
         }
+        else if (args[i] == QLatin1String("--trace"))
+        {
+            tracing = true;
+        }
+        else if (args[i] == QLatin1String("--channelFd"))
+        {
+            i++;
+            if (i < args.length())
+                channelFd = args[i].toInt();
+        }
+        else if (args[i] == QLatin1String("--descriptorFd"))
+        {
+            i++;
+            if (i < args.length())
+                descriptorFd = args[i].toInt();
+        }
         else if (args[i] == QLatin1String("--serviceType"))
         {
             i++;
@@ -95,38 +237,194 @@ ProviderPluginProcessPrivate::ProviderPluginProcessPrivate(ProviderPluginProcess
     }
 }
 
-ProviderPluginProcessPrivate::~ProviderPluginProcessPrivate()
+void ProviderPluginProcessPrivate::openChannel()
+{
+    if (channelFd < 0 && socketName.isEmpty())
+        return;
+
+    /* The channel stays open for the whole lifetime of the plugin, so that
+     * the caller can send requests while the plugin is running. */
+    QLocalSocket *socket = new QLocalSocket();
+    connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
+            this, SLOT(onSocketError(QLocalSocket::LocalSocketError)));
+    if (channelFd >= 0) {
+        /* inherited from the caller; our own children mustn't get it */
+        ::fcntl(channelFd, F_SETFD, FD_CLOEXEC);
+        if (!socket->setSocketDescriptor(channelFd)) {
+            delete socket;
+            return;
+        }
+    } else {
+        /* callers which still use a named server */
+        socket->connectToServer(socketName);
+        if (!socket->waitForConnected()) {
+            delete socket;
+            return;
+        }
+    }
+
+    channel = new PluginChannel(socket, this);
+    connect(channel, SIGNAL(messageReceived(int, const QByteArray &)),
+            this, SLOT(onMessageReceived(int, const QByteArray &)));
+    connect(channel, SIGNAL(disconnected()), this, SLOT(onChannelClosed()));
+
+    if (descriptorFd >= 0) {
+        ::fcntl(descriptorFd, F_SETFD, FD_CLOEXEC);
+        channel->setDescriptorSocket(descriptorFd);
+    }
+    trace("channel-open");
+}
+
+bool ProviderPluginProcessPrivate::sendSharedResult(const QByteArray &result)
 {
+    if (result.size() < sharedResultThreshold ||
+        !channel->hasDescriptorSocket())
+        return false;
+
+    int fd = PluginChannel::createSharedBuffer(result);
+    if (fd < 0)
+        return false;
+
+    /* the descriptor is on its way before the message announcing it */
+    bool sent = channel->sendDescriptor(fd);
+    ::close(fd);
+    if (!sent)
+        return false;
+
+    QByteArray size;
+    QDataStream stream(&size, QIODevice::WriteOnly);
+    stream << quint64(result.size());
+    return channel->sendMessage(PluginChannel::SharedResult, size);
 }
 
-void ProviderPluginProcessPrivate::sendResultToCaller()
+void ProviderPluginProcessPrivate::onMessageReceived(int type,
+                                                     const QByteArray &payload)
 {
-    if (!socketName.isEmpty()) {
-        QLocalSocket *socket = new QLocalSocket();
-        connect(socket, SIGNAL(error(QLocalSocket::LocalSocketError)),
-                this, SLOT(onSocketError(QLocalSocket::LocalSocketError)));
-        socket->connectToServer(socketName);
+    Q_Q(ProviderPluginProcess);
+
+    switch (type) {
+    case PluginChannel::Cancel:
+        /* plugins which don't handle cancellation just terminate */
+        if (q->receivers(SIGNAL(cancelRequested())) > 0)
+            emit q->cancelRequested();
+        else
+            q->setReturnToAccountsList(true);
+        break;
+    case PluginChannel::Focus:
+        emit q->focusRequested();
+        break;
+    case PluginChannel::Parameters:
+        parameters = PluginChannel::toVariant(payload).toMap();
+        emit q->parametersUpdated(parameters);
+        break;
+    case PluginChannel::Launch:
+        if (launched)
+            break;
+        launched = launch.decode(payload);
+        if (!launched) {
+            qWarning() << "Invalid launch message";
+            exit(EXIT_FAILURE);
+        }
+
+        /* the first launch is waited for by init() */
+        if (idle) {
+            idle = false;
+            trace("launch-received");
+            applyLaunch();
+            flushTrace();
+            emit q->requestReceived();
+        }
+        break;
+    default:
+        qWarning() << "Unexpected message from caller:" << type;
+    }
+}
+
+void ProviderPluginProcessPrivate::sendToCaller(int type,
+                                                const QVariant &value)
+{
+    if (hosted) {
+        QByteArray payload;
+        QDataStream stream(&payload, QIODevice::WriteOnly);
+        stream << value;
+        emit hostMessage(type, payload);
+    } else if (channel != 0) {
+        channel->sendVariant(PluginChannel::MessageType(type), value);
+    }
+}
+
+void ProviderPluginProcessPrivate::trace(const char *phase)
+{
+    tracePoints.append(PluginTracePoint(QString::fromLatin1(phase),
+                                        PluginTrace::timestamp()));
+    flushTrace();
+}
+
+void ProviderPluginProcessPrivate::flushTrace()
+{
+    /* Points are recorded before the arguments are known, but sent only if
+     * the caller asked for them; until the channel is open, they are
+     * kept. */
+    if (!tracing || tracePoints.isEmpty())
+        return;
+
+    QByteArray payload =
+        PluginTrace::encode(QCoreApplication::applicationPid(), tracePoints);
+    if (hosted)
+        emit hostMessage(PluginChannel::Trace, payload);
+    else if (channel != 0)
+        channel->sendMessage(PluginChannel::Trace, payload);
+    else
+        return;
+
+    tracePoints.clear();
+}
 
+Accounts::AccountId ProviderPluginProcessPrivate::accountIdForCaller()
+{
+    /* a plugin which never looked at the account hasn't created it */
+    if (account == 0)
+        return setupType == EditExisting ? accountId : 0;
+    return account->id();
+}
+
+void ProviderPluginProcessPrivate::sendResultToCaller(bool stayConnected)
+{
+    trace("result-sent");
+
+    if (hosted || channel != 0) {
         QByteArray ba;
         QDataStream stream(&ba, QIODevice::WriteOnly);
 
         if (editExistingAccount)
             stream << existingAccountId;
         else if (!goToAccountsPage)
-            stream << account->id();
+            stream << accountIdForCaller();
         else
             stream << cancelId;
 
         stream << exitData;
-        socket->write(ba);
-        socket->flush();
-        socket->close();
-    } else {
+        if (hosted) {
+            emit hostMessage(PluginChannel::Result, ba);
+            return;
+        }
+
+        if (!sendSharedResult(ba))
+            channel->sendMessage(PluginChannel::Result, ba);
+        if (stayConnected)
+            return;
+
+        /* The process is about to exit: make sure that the caller got the
+         * whole result, however large. */
+        if (!channel->waitForBytesWritten(resultTimeout))
+            qWarning() << "Result not delivered";
+        channel->socket()->disconnectFromServer();
+    } else if (channelFd < 0 && socketName.isEmpty()) {
         QByteArray ba;
         if (editExistingAccount)
             ba = QString::number(existingAccountId).toAscii();
         else if (!goToAccountsPage)
-            ba = QString::number(account->id()).toAscii();
+            ba = QString::number(accountIdForCaller()).toAscii();
         else
             ba = QString::number(cancelId).toAscii();
 
@@ -137,6 +435,48 @@ void ProviderPluginProcessPrivate::sendResultToCaller()
     }
 }
 
+void ProviderPluginProcessPrivate::onChannelClosed()
+{
+    /* an idle plugin is of no use once the caller has dropped it */
+    if (idle)
+        QCoreApplication::exit(0);
+}
+
+bool ProviderPluginProcessPrivate::canServe()
+{
+    Q_Q(ProviderPluginProcess);
+
+    return serverMode && !hosted && channel != 0 &&
+        channel->socket()->state() == QLocalSocket::ConnectedState &&
+        q->receivers(SIGNAL(requestReceived())) > 0;
+}
+
+void ProviderPluginProcessPrivate::becomeIdle()
+{
+    /* The next request starts from a clean state, but the DB stays
+     * open; the plugin might still refer to the account for a while. */
+    if (account != 0)
+        account->deleteLater();
+    account = 0;
+    setupType = Unset;
+    accountId = 0;
+    providerName.clear();
+    serviceType.clear();
+    parameters.clear();
+    arguments = baseArguments;
+    launch = PluginLaunch();
+    launched = false;
+    goToAccountsPage = false;
+    exitData = QVariant();
+    editExistingAccount = false;
+    existingAccountId = 0;
+    tracing = false;
+    tracePoints.clear();
+
+    idle = true;
+    channel->sendMessage(PluginChannel::Idle);
+}
+
 void ProviderPluginProcessPrivate::onSocketError(QLocalSocket::LocalSocketError status)
 {
     qDebug() << Q_FUNC_INFO << status;
@@ -146,9 +486,25 @@ ProviderPluginProcess::ProviderPluginProcess(QObject *object):
     QObject(object),
     d_ptr(new ProviderPluginProcessPrivate(this))
 {
+    Q_D(ProviderPluginProcess);
+
     if (plugin_instance != 0)
         qWarning() << "ProviderPluginProcess already instantiated";
     plugin_instance = this;
+    d->init();
+}
+
+ProviderPluginProcess::ProviderPluginProcess(Accounts::Manager *manager,
+                                             const PluginLaunch &launch,
+                                             QObject *parent):
+    QObject(parent),
+    d_ptr(new ProviderPluginProcessPrivate(this))
+{
+    Q_D(ProviderPluginProcess);
+
+    /* several plugins can be running inside the caller: this is not the
+     * instance() of the process */
+    d->initHosted(manager, launch);
 }
 
 ProviderPluginProcess::~ProviderPluginProcess()
@@ -171,7 +527,25 @@ SetupType ProviderPluginProcess::setupType() const
 Accounts::Account *ProviderPluginProcess::account() const
 {
     Q_D(const ProviderPluginProcess);
-    return d->account;
+    return const_cast<ProviderPluginProcessPrivate *>(d)->loadAccount();
+}
+
+QStringList ProviderPluginProcess::arguments() const
+{
+    Q_D(const ProviderPluginProcess);
+    return d->arguments;
+}
+
+QVariantMap ProviderPluginProcess::parameters() const
+{
+    Q_D(const ProviderPluginProcess);
+    return d->parameters;
+}
+
+QVariantMap ProviderPluginProcess::accountSnapshot() const
+{
+    Q_D(const ProviderPluginProcess);
+    return d->launch.accountSnapshot;
 }
 
 QString ProviderPluginProcess::serviceType() const
@@ -209,10 +583,57 @@ void ProviderPluginProcess::setEditExistingAccount(Accounts::AccountId accountId
     d->existingAccountId = accountId;
 }
 
+void ProviderPluginProcess::reportProgress(const QVariant &progress)
+{
+    Q_D(ProviderPluginProcess);
+    d->sendToCaller(PluginChannel::Progress, progress);
+}
+
+void ProviderPluginProcess::sendPartialResult(const QVariant &data)
+{
+    Q_D(ProviderPluginProcess);
+    d->sendToCaller(PluginChannel::PartialResult, data);
+}
+
+void ProviderPluginProcess::reportUiReady()
+{
+    Q_D(ProviderPluginProcess);
+    d->trace("ui-ready");
+}
+
+void ProviderPluginProcess::reportAccountReady()
+{
+    Q_D(ProviderPluginProcess);
+
+    Accounts::AccountId id = d->editExistingAccount ?
+        d->existingAccountId : d->accountIdForCaller();
+    if (id == 0) {
+        qWarning() << "No stored account to report";
+        return;
+    }
+    d->trace("account-ready");
+    d->sendToCaller(PluginChannel::AccountReady, id);
+    /* the plugin might block while tearing down its UI */
+    if (d->channel != 0)
+        d->channel->socket()->flush();
+}
+
 void ProviderPluginProcess::quit()
 {
     Q_D(ProviderPluginProcess);
+
+    /* the result has been delivered already */
+    if (d->idle)
+        return;
+
+    if (d->canServe()) {
+        d->sendResultToCaller(true);
+        d->becomeIdle();
+        return;
+    }
+
     d->sendResultToCaller();
-    QCoreApplication::exit(0);
+    if (!d->hosted)
+        QCoreApplication::exit(0);
 }
 
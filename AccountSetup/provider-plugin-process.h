@@ -33,12 +33,16 @@
 
 // Accounts
 #include <Accounts/Account>
+#include <Accounts/Manager>
 
 // Qt
 #include <QObject>
+#include <QStringList>
+#include <QVariant>
 #include <QWidget>
 
 namespace AccountSetup {
+struct PluginLaunch;
 class ProviderPluginProcessPrivate;
 
 /*!
@@ -63,7 +67,9 @@ public:
     virtual ~ProviderPluginProcess();
 
     /*!
-     * Get the instance of the object.
+     * Get the instance of the object. Plugins running in-process, inside
+     * the caller, get their ProviderPluginProcess from
+     * ProviderPluginInterface::start() instead.
      */
     static ProviderPluginProcess *instance();
 
@@ -76,9 +82,41 @@ public:
      * Gets the account being setup by this plugin.
      * @note The returned object might not refer to an account stored on the
      * accounts DB, if the task of this plugin is to create a new account.
+     * @note The accounts DB is opened and the account is loaded the first
+     * time this method is called, so plugins which show their UI before
+     * calling it don't have to wait for the DB.
      */
     Accounts::Account *account() const;
 
+    /*!
+     * Gets the arguments this plugin was launched with: --create or
+     * --edit, --serviceType, --windowId and the additional parameters.
+     * A freshly started plugin also gets them on its command line, after
+     * --launch. Plugins started with ProviderPluginProxy::startStandbyPlugin()
+     * or reused in server mode were already running, and only get them
+     * here: plugins should therefore use this instead of
+     * QCoreApplication::arguments().
+     */
+    QStringList arguments() const;
+
+    /*!
+     * Gets the parameters sent by the caller, with the launch or later.
+     * Unlike arguments(), they can be of any type and size.
+     * @sa parametersUpdated()
+     */
+    QVariantMap parameters() const;
+
+    /*!
+     * Gets the settings of the account being edited, as the caller saw them
+     * when launching the plugin. They can be used to show the UI before
+     * account() loads the account from the DB.
+     *
+     * @return A map with the "id", "displayName" and "enabled" properties of
+     * the account, and its global settings under "settings"; an empty map
+     * if the plugin was launched to create an account.
+     */
+    QVariantMap accountSnapshot() const;
+
     /*!
      * @return The service type.
      */
@@ -109,13 +147,81 @@ public:
      */
     void setEditExistingAccount(Accounts::AccountId accountId);
 
+    /*!
+     * Sends progress information to the caller, while the plugin is
+     * running.
+     * @param progress Plugin specific progress information.
+     */
+    void reportProgress(const QVariant &progress);
+
+    /*!
+     * Sends some results to the caller, before the plugin terminates.
+     * @param data Plugin specific data.
+     */
+    void sendPartialResult(const QVariant &data);
+
+    /*!
+     * Tells the caller that the plugin UI has been shown. This is only used
+     * to trace the plugin startup time.
+     * @sa ProviderPluginProxy::setTracingEnabled()
+     */
+    void reportUiReady();
+
+    /*!
+     * Tells the caller that the account has been stored, so that it can
+     * start using it while the plugin is still shutting down; call it right
+     * after Accounts::Account::sync() has completed. The caller is told
+     * anyway when the plugin quits, if it hasn't been told before.
+     * @sa ProviderPluginProxy::accountReady()
+     */
+    void reportAccountReady();
+
 public Q_SLOTS:
     /*!
-     * Clean termination of the plugin process.
+     * Clean termination of the plugin process. For plugins running
+     * in-process, this delivers the results to the caller, which then
+     * deletes this object.
      */
     void quit();
 
+Q_SIGNALS:
+    /*!
+     * Emitted when the caller asks the plugin to terminate as soon as
+     * possible. If no slot is connected to this signal, the plugin quits as
+     * if setReturnToAccountsList() had been called.
+     */
+    void cancelRequested();
+
+    /*!
+     * Emitted when the caller asks the plugin to bring its UI to the
+     * foreground.
+     */
+    void focusRequested();
+
+    /*!
+     * Emitted when the caller sends new parameters to the plugin.
+     * @param parameters Caller specific parameters.
+     */
+    void parametersUpdated(const QVariantMap &parameters);
+
+    /*!
+     * Emitted when a new request arrives, for plugins running in server
+     * mode. Plugins which connect to this signal can handle more than one
+     * request: if the caller asks for it, quit() delivers the result and
+     * keeps the plugin running, waiting for the next request, instead of
+     * exiting. setupType(), account(), arguments() and the other accessors
+     * then describe the new request.
+     * Plugins which don't connect to this signal exit after each request,
+     * as usual.
+     * @sa ProviderPluginProxy::setIdlePluginLimit()
+     */
+    void requestReceived();
+
 private:
+    friend class ProviderPluginSessionPrivate;
+    ProviderPluginProcess(Accounts::Manager *manager,
+                          const PluginLaunch &launch, QObject *parent);
+
     ProviderPluginProcessPrivate *d_ptr;
     Q_DECLARE_PRIVATE(ProviderPluginProcess)
 };
@@ -24,15 +24,22 @@
 #define ACCOUNTSETUP_PROVIDER_PLUGIN_PROXY_PRIV_H
 
 //libAccountSetup
+#include "plugin-resolver.h"
 #include "provider-plugin-proxy.h"
+#include "provider-plugin-session.h"
+#include "provider-plugin-session-priv.h"
 
 //Qt
 #include <QDebug>
 #include <QDir>
 #include <QFileInfo>
-#include <QLocalServer>
+#include <QFutureInterface>
+#include <QHash>
+#include <QList>
+#include <QMutex>
 #include <QPointer>
 #include <QProcess>
+#include <QTimer>
 #include <QWidget>
 
 using namespace Accounts;
@@ -40,6 +47,16 @@ using namespace AccountSetup;
 
 namespace AccountSetup {
 
+/* A launch requested with the asynchronous API, maybe from another thread */
+struct AsyncLaunch
+{
+    SetupType setupType;
+    Provider provider;
+    Account *account;
+    QString serviceType;
+    QFutureInterface<ProviderPluginResult> future;
+};
+
 class ProviderPluginProxyPrivate: public QObject
 {
     Q_OBJECT
@@ -48,48 +65,84 @@ class ProviderPluginProxyPrivate: public QObject
 public:
     ProviderPluginProxyPrivate(ProviderPluginProxy *parent):
         q_ptr(parent),
-        pluginName(),
-        process(0),
-        socketName(QString()),
-        createdAccountId(0),
-        error(ProviderPluginProxy::NoError),
-        setupType(Unset),
-        providerName(),
-        exitData()
+        resultTimeout(10000),
+        inProcessEnabled(false),
+        manager(0),
+        tracingEnabled(false),
+        lastSessionId(0),
+        outputSink(ProviderPluginProxy::LogOutput),
+        outputBufferSize(64 * 1024),
+        outputRateLimit(16 * 1024),
+        launcher(ProviderPluginProxy::ForkLauncher),
+        priority(ProviderPluginProxy::InteractivePriority),
+        idlePluginLimit(0),
+        idlePluginTimeout(60000)
     {
         pluginDirs << QString::fromLatin1("/usr/lib/AccountSetup");
+        idleTimer.setSingleShot(true);
+        connect(&idleTimer, SIGNAL(timeout()), this, SLOT(onIdleTimeout()));
     }
     ~ProviderPluginProxyPrivate();
 
-    void startProcess(Provider provider, AccountId accountId,
-                      const QString &serviceType);
-    bool findPlugin(Provider provider, QString &pluginPath,
-                    QString &pluginFileName);
+    ProviderPluginSession *createSession();
+    ProviderPluginSession *startProcess(Provider provider,
+                                        Account *account,
+                                        const QString &serviceType,
+                                        ProviderPluginProxy::Priority priority,
+                                        const QStringList &parameters =
+                                        QStringList());
+    void startScheduled(ProviderPluginSessionPrivate *sessionPriv);
+    void prepare(Provider provider);
+    PluginLocation findPlugin(Provider provider);
+    Manager *hostManager();
+    bool startStandby(Provider provider, QString *startedPath = 0);
+    void stopStandby(const QString &pluginPath);
+    bool takeStandby(const QString &pluginPath, StandbyPlugin &standby);
+    void addIdle(const QString &pluginPath, StandbyPlugin &idle);
+    void watchStandby(StandbyPlugin &standby);
+    void scheduleIdleTimeout();
+    void logTraceEvents(ProviderPluginSession *session);
+    QFuture<ProviderPluginResult> startAsync(SetupType setupType,
+                                             Provider provider,
+                                             Account *account,
+                                             const QString &serviceType);
+    void startAsyncLaunch(AsyncLaunch &launch);
 
 private Q_SLOTS:
-    void onReadStandardError();
-    void onError(QProcess::ProcessError);
-    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
-    void onNewConnection();
-    void setCommunicationChannel();
+    void onAsyncLaunches();
+    void onIdleTimeout();
+    void onReadStandbyOutput();
+    void onStandbyFinished();
+    void onSessionFinished();
 
 private:
     mutable ProviderPluginProxy *q_ptr;
-    QString pluginName;
-    QProcess *process;
-    QString socketName;
-    AccountId createdAccountId;
     QStringList pluginDirs;
-    ProviderPluginProxy::Error error;
     QPointer<QWidget> parentWidget;
     QStringList additionalParameters;
-    QByteArray pluginOutput;
-    SetupType setupType;
-    QString providerName;
-    QVariant exitData;
+    QVariantMap launchParameters;
+    int resultTimeout;
+    bool inProcessEnabled;
+    Manager *manager;
+    QHash<QString, StandbyPlugin> standbyPlugins;
+    QList<QPointer<ProviderPluginSession> > runningSessions;
+    QPointer<ProviderPluginSession> lastSession;
+    bool tracingEnabled;
+    int lastSessionId;
+    QList<ProviderPluginTraceEvent> traceLog;
+    ProviderPluginProxy::OutputSink outputSink;
+    QString outputFileName;
+    int outputBufferSize;
+    int outputRateLimit;
+    ProviderPluginProxy::Launcher launcher;
+    QMutex asyncMutex;
+    QList<AsyncLaunch> asyncLaunches;
+    ProviderPluginProxy::Priority priority;
+    int idlePluginLimit;
+    int idlePluginTimeout;
+    QTimer idleTimer;
 };
 
 }; // namespace
 
 #endif // ACCOUNTSETUP_PROVIDER_PLUGIN_PROXY_PRIV_H
-
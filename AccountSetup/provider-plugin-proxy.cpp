@@ -22,213 +22,515 @@
 
 #include "provider-plugin-proxy.h"
 #include "provider-plugin-proxy-priv.h"
+#include "provider-plugin-batch.h"
+#include "plugin-channel.h"
+#include "plugin-launcher.h"
+#include "plugin-metrics.h"
+#include "plugin-prefetch.h"
+#include "plugin-scheduler.h"
 
 #include <Accounts/Manager>
 
 #include <QDebug>
-#include <QLocalServer>
-#include <QLocalSocket>
+#include <QFile>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
 
 using namespace Accounts;
 using namespace AccountSetup;
 
+/* the oldest events are dropped beyond this */
+static const int maxTraceEvents = 10000;
+
+static QString jsonString(const QString &string)
+{
+    QString escaped;
+    escaped.reserve(string.length() + 2);
+    escaped += QLatin1Char('"');
+    foreach (QChar c, string) {
+        if (c == QLatin1Char('"') || c == QLatin1Char('\\')) {
+            escaped += QLatin1Char('\\');
+            escaped += c;
+        } else if (c.unicode() < 0x20) {
+            escaped += QString::fromLatin1("\\u%1")
+                .arg(c.unicode(), 4, 16, QLatin1Char('0'));
+        } else {
+            escaped += c;
+        }
+    }
+    escaped += QLatin1Char('"');
+    return escaped;
+}
+
 
 ProviderPluginProxyPrivate::~ProviderPluginProxyPrivate()
 {
     qDebug() << Q_FUNC_INFO;
-    if (process) {
-        process->disconnect();
-        process->close();
-        delete process;
+
+    QHash<QString, StandbyPlugin>::iterator i;
+    for (i = standbyPlugins.begin(); i != standbyPlugins.end(); ++i)
+        i->stop();
+
+    /* launches which were never started */
+    QMutexLocker locker(&asyncMutex);
+    foreach (AsyncLaunch launch, asyncLaunches) {
+        ProviderPluginResult result;
+        result.m_providerName = launch.provider.name();
+        result.m_serviceType = launch.serviceType;
+        result.m_finished = true;
+        result.m_error = ProviderPluginProxy::Cancelled;
+        launch.future.reportResult(result);
+        launch.future.reportFinished();
     }
+    asyncLaunches.clear();
 }
 
-void ProviderPluginProxyPrivate::startProcess(Provider provider,
-                                              AccountId accountId,
-                                              const QString &serviceType)
+ProviderPluginSession *ProviderPluginProxyPrivate::createSession()
 {
     Q_Q(ProviderPluginProxy);
 
-    error = ProviderPluginProxy::NoError;
-    createdAccountId = 0;
-    pluginOutput.clear();
-
-    QString processName;
-    QString pluginFileName;
+    ProviderPluginSession *session = new ProviderPluginSession(q);
+    connect(session, SIGNAL(finished()), this, SLOT(onSessionFinished()));
+    connect(session, SIGNAL(accountReady(Accounts::AccountId)),
+            q, SIGNAL(accountReady(Accounts::AccountId)));
+    lastSession = session;
+
+    ProviderPluginSessionPrivate *sessionPriv = session->d_func();
+    sessionPriv->output.setCapacity(outputBufferSize);
+    sessionPriv->outputLimiter.setRate(outputRateLimit);
+    sessionPriv->setOutputSink(outputSink, outputFileName);
+    sessionPriv->launcher = launcher;
+    sessionPriv->sessionId = ++lastSessionId;
+    sessionPriv->tracing = tracingEnabled;
+    sessionPriv->trace("session-created");
+    return session;
+}
 
-    if (!findPlugin(provider, processName, pluginFileName)) {
-        error = ProviderPluginProxy::PluginNotFound;
-        emit q->finished();
-        return;
+static QVariantMap accountSnapshot(Account *account)
+{
+    QVariantMap settings;
+    foreach (const QString &key, account->allKeys()) {
+        QVariant value;
+        account->value(key, value);
+        settings.insert(key, value);
     }
-    providerName = provider.name();
-    pid_t pid = getpid();
-    socketName = provider.name() + QString::number(pid);
 
-    QStringList arguments;
-    arguments << QLatin1String("--socketName") << socketName;
+    QVariantMap snapshot;
+    snapshot.insert(QLatin1String("id"), account->id());
+    snapshot.insert(QLatin1String("displayName"), account->displayName());
+    snapshot.insert(QLatin1String("enabled"), account->enabled());
+    snapshot.insert(QLatin1String("settings"), settings);
+    return snapshot;
+}
+
+ProviderPluginSession *
+ProviderPluginProxyPrivate::startProcess(Provider provider,
+                                         Account *account,
+                                         const QString &serviceType,
+                                         ProviderPluginProxy::Priority priority,
+                                         const QStringList &parameters)
+{
+    ProviderPluginSession *session = createSession();
+    ProviderPluginSessionPrivate *sessionPriv = session->d_func();
+    sessionPriv->serviceType = serviceType;
+    sessionPriv->metrics.setProvider(provider.name());
+
+    PluginLocation location = findPlugin(provider);
+    sessionPriv->trace("plugin-resolved");
+    bool inProcess = inProcessEnabled && !location.libraryPath.isEmpty();
+    if (!inProcess && location.path.isEmpty()) {
+        sessionPriv->finish(ProviderPluginProxy::PluginNotFound);
+        return session;
+    }
+    sessionPriv->providerName = provider.name();
+
+    /* The plugin gets its task in the launch message. The equivalent
+     * command line is in ProviderPluginProcess::arguments(), and also in
+     * the process arguments of the plugins started for this launch; those
+     * started in standby, or reused in server mode, can't have it. */
+    PluginLaunch launch;
+    launch.serviceType = serviceType;
+    launch.parameters = launchParameters;
+    if (tracingEnabled)
+        launch.flags |= PluginLaunch::Trace;
 
     if (parentWidget != 0) {
         WId windowId = parentWidget->effectiveWinId();
-        arguments << QLatin1String("--windowId") << QString::number(windowId);
+        launch.windowId = quint64(windowId);
+        launch.arguments << QLatin1String("--windowId") <<
+            QString::number(windowId);
     }
 
-    if (accountId != 0) {
-        arguments << QLatin1String("--edit") << QString::number(accountId);
-        setupType = EditExisting;
+    if (account != 0) {
+        launch.setupType = EditExisting;
+        launch.accountId = account->id();
+        launch.accountSnapshot = accountSnapshot(account);
+        launch.arguments << QLatin1String("--edit") <<
+            QString::number(account->id());
     } else {
-        arguments << QLatin1String("--create") << provider.name();
-        setupType = CreateNew;
+        launch.setupType = CreateNew;
+        launch.providerName = provider.name();
+        launch.arguments << QLatin1String("--create") << provider.name();
     }
+    sessionPriv->setupType = launch.setupType;
 
     if (!serviceType.isEmpty())
-        arguments << QLatin1String("--serviceType") << serviceType;
+        launch.arguments << QLatin1String("--serviceType") << serviceType;
 
-    arguments += additionalParameters;
+    launch.arguments += additionalParameters;
+    launch.arguments += parameters;
 
+    /* for the toolkit of the plugin process */
+    QStringList arguments;
 #ifndef QT_NO_DEBUG_OUTPUT
     arguments << QLatin1String("-output-level") << QLatin1String("debug");
 #endif
 
-    if (!process)
-        process = new QProcess();
-
-    pluginName = pluginFileName;
+    /* plugins which support it stay for the next request */
+    if (idlePluginLimit > 0)
+        arguments << QLatin1String("--server");
+
+    sessionPriv->resultTimeout = resultTimeout;
+    sessionPriv->serverMode = idlePluginLimit > 0;
+    sessionPriv->pluginPath = location.path;
+    sessionPriv->proxy = this;
+
+    if (inProcess) {
+        sessionPriv->pluginName = QFileInfo(location.libraryPath).fileName();
+        sessionPriv->metrics.setPlugin(sessionPriv->pluginName);
+        runningSessions.append(session);
+        if (sessionPriv->startHosted(location.libraryPath, hostManager(),
+                                     launch))
+            return session;
+
+        runningSessions.removeAll(session);
+        if (location.path.isEmpty()) {
+            sessionPriv->finish(ProviderPluginProxy::PluginNotFound);
+            return session;
+        }
+    }
 
-    qDebug() << Q_FUNC_INFO << processName << arguments;
+    sessionPriv->pluginName = location.fileName;
+    sessionPriv->metrics.setPlugin(location.fileName);
+    runningSessions.append(session);
 
-    connect(process, SIGNAL(readyReadStandardError()),
-            this, SLOT(onReadStandardError()));
-    connect(process, SIGNAL(error(QProcess::ProcessError)),
-            this, SLOT(onError(QProcess::ProcessError)));
-    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
-            this, SLOT(onFinished(int, QProcess::ExitStatus)));
-    connect(process, SIGNAL(started()), this, SLOT(setCommunicationChannel()));
+    /* the process is started when the other plugins leave room for it */
+    sessionPriv->scheduledPath = location.path;
+    sessionPriv->scheduledArguments = arguments;
+    sessionPriv->scheduledLaunch = launch;
+    if (sessionPriv->schedule(priority, this))
+        startScheduled(sessionPriv);
 
-    process->start(processName, arguments);
+    return session;
 }
 
-bool ProviderPluginProxyPrivate::findPlugin(Provider provider,
-                                            QString &pluginPath,
-                                            QString &pluginFileName)
+void ProviderPluginProxyPrivate::startScheduled(
+                                    ProviderPluginSessionPrivate *sessionPriv)
 {
-    static const char pluginNamePattern[] = "%1plugin";
-    bool pluginTagExists = true;
+    StandbyPlugin standby;
+    if (takeStandby(sessionPriv->scheduledPath, standby))
+        sessionPriv->startStandby(standby, sessionPriv->scheduledLaunch);
+    else
+        sessionPriv->start(sessionPriv->scheduledPath,
+                           sessionPriv->scheduledArguments,
+                           sessionPriv->scheduledLaunch);
+}
 
-    QDomElement root(provider.domDocument().documentElement());
-    QString pluginName(root.
-                       firstChildElement(QString::fromLatin1("plugin")).
-                       text());
-    if (pluginName.isEmpty()) {
-        pluginName = provider.name();
-        pluginTagExists = false;
+QFuture<ProviderPluginResult>
+ProviderPluginProxyPrivate::startAsync(SetupType setupType,
+                                       Provider provider,
+                                       Account *account,
+                                       const QString &serviceType)
+{
+    AsyncLaunch launch;
+    launch.setupType = setupType;
+    launch.provider = provider;
+    launch.account = account;
+    launch.serviceType = serviceType;
+    launch.future.reportStarted();
+    QFuture<ProviderPluginResult> future = launch.future.future();
+
+    if (QThread::currentThread() == thread()) {
+        startAsyncLaunch(launch);
+        return future;
     }
 
-    QStringList pluginFileNames;
-    pluginFileNames << QString::fromLatin1(pluginNamePattern).arg(pluginName);
+    /* sessions can only live in the thread of the proxy */
+    QMutexLocker locker(&asyncMutex);
+    if (asyncLaunches.isEmpty())
+        QMetaObject::invokeMethod(this, "onAsyncLaunches",
+                                  Qt::QueuedConnection);
+    asyncLaunches.append(launch);
+    return future;
+}
 
-    /* If a plugin for the specified name cannot be found and
-     * the plugin is not specified in the provider file, fallback to
-     * "genericplugin"
-     */
-    if (!pluginTagExists) {
-        pluginFileNames << QString::fromLatin1(pluginNamePattern).
-            arg(QLatin1String("generic"));
-    }
+void ProviderPluginProxyPrivate::startAsyncLaunch(AsyncLaunch &launch)
+{
+    Q_Q(ProviderPluginProxy);
 
-    foreach (QString name, pluginFileNames) {
-        foreach (QString pluginDir, pluginDirs) {
-            QFileInfo pluginFileInfo(pluginDir, name);
+    ProviderPluginSession *session = launch.setupType == EditExisting ?
+        q->editAccount(launch.account, launch.serviceType) :
+        q->createAccount(launch.provider, launch.serviceType);
+    ProviderPluginSessionPrivate *sessionPriv = session->d_func();
+    sessionPriv->addFuture(launch.future);
 
-            if (pluginFileInfo.exists()) {
-                pluginPath = pluginFileInfo.canonicalFilePath();
-                pluginFileName = name;
-                return true;
-            }
-        }
+    /* nobody else has the session: it's done once the future is */
+    if (sessionPriv->done)
+        session->deleteLater();
+    else
+        connect(session, SIGNAL(finished()), session, SLOT(deleteLater()));
+}
+
+void ProviderPluginProxyPrivate::onAsyncLaunches()
+{
+    asyncMutex.lock();
+    QList<AsyncLaunch> launches = asyncLaunches;
+    asyncLaunches.clear();
+    asyncMutex.unlock();
+
+    for (int i = 0; i < launches.count(); i++)
+        startAsyncLaunch(launches[i]);
+}
+
+namespace {
+
+/* Resolves a plugin and reads its files ahead, in the global thread pool */
+class PluginPrepareTask: public QRunnable
+{
+public:
+    PluginPrepareTask(Provider provider, const QStringList &pluginDirs):
+        provider(provider),
+        pluginDirs(pluginDirs)
+    {
     }
 
-    return false;
+    void run()
+    {
+        PluginLocation location =
+            PluginResolver::instance()->resolve(provider, pluginDirs);
+        PluginPrefetch::prefetch(location.path);
+        PluginPrefetch::prefetch(location.libraryPath);
+    }
+
+private:
+    Provider provider;
+    QStringList pluginDirs;
+};
+
+} // namespace
+
+void ProviderPluginProxyPrivate::prepare(Provider provider)
+{
+    /* the resolver must belong to this thread, not to the worker */
+    PluginResolver::instance();
+    QThreadPool::globalInstance()->start(new PluginPrepareTask(provider,
+                                                               pluginDirs));
 }
 
-void ProviderPluginProxyPrivate::setCommunicationChannel()
+PluginLocation ProviderPluginProxyPrivate::findPlugin(Provider provider)
 {
-    QLocalServer *server = new QLocalServer();
-    QLocalServer::removeServer(socketName);
-    if (!server->listen(socketName))
-        qWarning() << "Server not up";
-    else
-        connect(server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+    return PluginResolver::instance()->resolve(provider, pluginDirs);
 }
 
-void ProviderPluginProxyPrivate::onNewConnection()
+Manager *ProviderPluginProxyPrivate::hostManager()
 {
-    QLocalServer *server = qobject_cast<QLocalServer*>(sender());
-    QLocalSocket *socket = server->nextPendingConnection();
-    if (!socket->waitForConnected()) {
-        qWarning() << "Server Connection not established";
-        return;
-    }
-    if (!socket->waitForReadyRead()) {
-        qWarning() << "Server data not available for reading";
-        return;
+    /* shared by all the plugins running in-process */
+    if (manager == 0)
+        manager = new Manager(this);
+    return manager;
+}
+
+bool ProviderPluginProxyPrivate::startStandby(Provider provider,
+                                              QString *startedPath)
+{
+    PluginLocation location = findPlugin(provider);
+
+    /* plugins running in-process have no startup to hide */
+    if (inProcessEnabled && !location.libraryPath.isEmpty())
+        return true;
+
+    QString processName = location.path;
+    if (processName.isEmpty())
+        return false;
+
+    if (standbyPlugins.contains(processName))
+        return true;
+
+    StandbyPlugin standby;
+    QStringList arguments;
+    arguments << QLatin1String("--standby");
+    if (idlePluginLimit > 0)
+        arguments << QLatin1String("--server");
+
+#ifndef QT_NO_DEBUG_OUTPUT
+    arguments << QLatin1String("-output-level") << QLatin1String("debug");
+#endif
+
+    qDebug() << Q_FUNC_INFO << processName << arguments;
+
+    PluginLauncher *process = PluginLauncher::create(launcher, this);
+    standby.process = process;
+    watchStandby(standby);
+
+    /* the launch arguments will be sent over the channel */
+    standby.channel = process->startWithChannel(processName, arguments);
+    if (standby.channel == 0) {
+        standby.stop();
+        return false;
     }
-    pluginOutput = socket->readAll();
-    socket->close();
+    standby.channel->setParent(this);
+
+    standby.idleSince.start();
+    standbyPlugins.insert(processName, standby);
+    scheduleIdleTimeout();
+    if (startedPath != 0)
+        *startedPath = processName;
+    return true;
 }
 
+void ProviderPluginProxyPrivate::stopStandby(const QString &pluginPath)
+{
+    StandbyPlugin standby;
+    if (takeStandby(pluginPath, standby))
+        standby.stop();
+}
 
-void ProviderPluginProxyPrivate::onReadStandardError()
+bool ProviderPluginProxyPrivate::takeStandby(const QString &pluginPath,
+                                             StandbyPlugin &standby)
 {
-    qDebug() << QString::fromLatin1(process->readAllStandardError());
+    QHash<QString, StandbyPlugin>::iterator i =
+        standbyPlugins.find(pluginPath);
+    if (i == standbyPlugins.end())
+        return false;
+
+    standby = i.value();
+    standbyPlugins.erase(i);
+    return true;
 }
 
-void ProviderPluginProxyPrivate::onError(QProcess::ProcessError err)
+void ProviderPluginProxyPrivate::watchStandby(StandbyPlugin &standby)
 {
-    Q_Q(ProviderPluginProxy);
+    connect(standby.process, SIGNAL(readyReadStandardOutput()),
+            this, SLOT(onReadStandbyOutput()));
+    connect(standby.process, SIGNAL(error(QProcess::ProcessError)),
+            this, SLOT(onStandbyFinished()));
+    connect(standby.process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onStandbyFinished()));
+}
 
-    if (err == QProcess::FailedToStart) {
-        pluginName.clear();
-        error = ProviderPluginProxy::PluginCrashed;
+void ProviderPluginProxyPrivate::addIdle(const QString &pluginPath,
+                                         StandbyPlugin &idle)
+{
+    /* one waiting process for each plugin is enough */
+    if (idlePluginLimit <= 0 || standbyPlugins.contains(pluginPath)) {
+        idle.stop();
+        return;
+    }
 
-        emit q->finished();
-        if (process) {
-            process->deleteLater();
-            process = NULL;
+    /* Idle and standby plugins share the pool: make room by stopping the
+     * one which has been waiting the longest. */
+    while (standbyPlugins.count() >= idlePluginLimit) {
+        QHash<QString, StandbyPlugin>::iterator oldest = standbyPlugins.begin();
+        QHash<QString, StandbyPlugin>::iterator i;
+        for (i = standbyPlugins.begin(); i != standbyPlugins.end(); ++i) {
+            if (i->idleSince.elapsed() > oldest->idleSince.elapsed())
+                oldest = i;
         }
+        oldest->stop();
+        standbyPlugins.erase(oldest);
     }
 
-    qDebug() << "Error: " << err;
+    idle.process->setParent(this);
+    idle.channel->setParent(this);
+    watchStandby(idle);
+    idle.idleSince.start();
+    standbyPlugins.insert(pluginPath, idle);
+    scheduleIdleTimeout();
 }
 
-void ProviderPluginProxyPrivate::onFinished(int exitCode,
-                                            QProcess::ExitStatus exitStatus)
+void ProviderPluginProxyPrivate::scheduleIdleTimeout()
 {
-    Q_Q(ProviderPluginProxy);
-    Q_UNUSED(exitCode);
+    if (idlePluginTimeout <= 0 || standbyPlugins.isEmpty()) {
+        idleTimer.stop();
+        return;
+    }
 
-    pluginName.clear();
+    qint64 longest = 0;
+    foreach (const StandbyPlugin &plugin, standbyPlugins)
+        longest = qMax(longest, plugin.idleSince.elapsed());
+    idleTimer.start(int(qMax(idlePluginTimeout - longest, qint64(0))));
+}
 
-    if (exitStatus == QProcess::CrashExit) {
-        error = ProviderPluginProxy::PluginCrashed;
-        emit q->finished();
-        process->deleteLater();
-        process = NULL;
-        return;
+void ProviderPluginProxyPrivate::onIdleTimeout()
+{
+    QHash<QString, StandbyPlugin>::iterator i = standbyPlugins.begin();
+    while (i != standbyPlugins.end()) {
+        if (i->idleSince.elapsed() >= idlePluginTimeout) {
+            qDebug() << "Stopping idle plugin:" << i.key();
+            i->stop();
+            i = standbyPlugins.erase(i);
+        } else {
+            ++i;
+        }
     }
+    scheduleIdleTimeout();
+}
 
-    QString value;
-    if (!pluginOutput.isEmpty()) {
-        QDataStream stream(pluginOutput);
-        stream.device()->seek(0);
-        stream >> createdAccountId >> exitData;
+void ProviderPluginProxyPrivate::onStandbyFinished()
+{
+    PluginLauncher *standbyProcess = qobject_cast<PluginLauncher*>(sender());
+
+    QHash<QString, StandbyPlugin>::iterator i;
+    for (i = standbyPlugins.begin(); i != standbyPlugins.end(); ++i) {
+        if (i->process == standbyProcess) {
+            qWarning() << "Standby plugin terminated:" << i.key();
+            standbyProcess->disconnect(this);
+            standbyProcess->deleteLater();
+            i->process = 0;
+            i->stop();
+            standbyPlugins.erase(i);
+            return;
+        }
     }
+}
 
-    if (process) {
-        process->deleteLater();
-        process = NULL;
+void ProviderPluginProxyPrivate::onReadStandbyOutput()
+{
+    /* A session taking over the process captures the rest; until then,
+     * the output is logged or dropped. */
+    PluginLauncher *plugin = qobject_cast<PluginLauncher*>(sender());
+    char chunk[4096];
+    qint64 length;
+    while ((length = plugin->read(chunk, sizeof(chunk))) > 0) {
+        if (outputSink == ProviderPluginProxy::LogOutput)
+            qDebug("standby: %.*s", int(length), chunk);
     }
+}
+
+void ProviderPluginProxyPrivate::logTraceEvents(ProviderPluginSession *session)
+{
+    if (!tracingEnabled)
+        return;
+
+    traceLog += session->traceEvents();
+    int excess = traceLog.count() - maxTraceEvents;
+    if (excess > 0)
+        traceLog.erase(traceLog.begin(), traceLog.begin() + excess);
+}
 
+void ProviderPluginProxyPrivate::onSessionFinished()
+{
+    Q_Q(ProviderPluginProxy);
+
+    ProviderPluginSession *session =
+        qobject_cast<ProviderPluginSession*>(sender());
+    runningSessions.removeAll(session);
+    logTraceEvents(session);
+
+    emit q->finished(session);
     emit q->finished();
 }
 
@@ -244,36 +546,54 @@ ProviderPluginProxy::~ProviderPluginProxy()
     delete d;
 }
 
-void ProviderPluginProxy::createAccount(Accounts::Provider provider,
-                                        const QString &serviceType)
+ProviderPluginSession *
+ProviderPluginProxy::createAccount(Accounts::Provider provider,
+                                   const QString &serviceType)
 {
     Q_D(ProviderPluginProxy);
 
     if (!provider.isValid()) {
         qCritical() << " NULL pointer to provider";
-        d->error = ProviderPluginProxy::PluginNotFound;
-        emit finished();
-        return;
+        ProviderPluginSession *session = d->createSession();
+        session->d_func()->finish(ProviderPluginProxy::PluginNotFound);
+        return session;
     }
 
-    d->startProcess(provider, 0, serviceType);
+    return d->startProcess(provider, 0, serviceType, d->priority);
 }
 
-void ProviderPluginProxy::editAccount(Accounts::Account *account,
-                                      const QString &serviceType)
+ProviderPluginSession *
+ProviderPluginProxy::editAccount(Accounts::Account *account,
+                                 const QString &serviceType)
 {
     Q_D(ProviderPluginProxy);
 
     if (!account) {
         qCritical() << " NULL pointer to account";
-        d->error = ProviderPluginProxy::AccountNotFound;
-        emit finished();
-        return;
+        ProviderPluginSession *session = d->createSession();
+        session->d_func()->finish(ProviderPluginProxy::AccountNotFound);
+        return session;
     }
 
     Manager *manager = account->manager();
     Provider provider = manager->provider(account->providerName());
-    d->startProcess(provider, account->id(), serviceType);
+    return d->startProcess(provider, account, serviceType, d->priority);
+}
+
+QFuture<ProviderPluginResult>
+ProviderPluginProxy::createAccountAsync(Accounts::Provider provider,
+                                        const QString &serviceType)
+{
+    Q_D(ProviderPluginProxy);
+    return d->startAsync(CreateNew, provider, 0, serviceType);
+}
+
+QFuture<ProviderPluginResult>
+ProviderPluginProxy::editAccountAsync(Accounts::Account *account,
+                                      const QString &serviceType)
+{
+    Q_D(ProviderPluginProxy);
+    return d->startAsync(EditExisting, Provider(), account, serviceType);
 }
 
 void ProviderPluginProxy::setParentWidget(QWidget *parent)
@@ -288,6 +608,240 @@ void ProviderPluginProxy::setPluginDirectories(const QStringList &pluginDirs)
     d->pluginDirs = pluginDirs;
 }
 
+void ProviderPluginProxy::setResultTimeout(int msecs)
+{
+    Q_D(ProviderPluginProxy);
+    d->resultTimeout = msecs;
+}
+
+int ProviderPluginProxy::resultTimeout() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->resultTimeout;
+}
+
+bool ProviderPluginProxy::startStandbyPlugin(Accounts::Provider provider)
+{
+    Q_D(ProviderPluginProxy);
+
+    if (!provider.isValid()) {
+        qCritical() << " NULL pointer to provider";
+        return false;
+    }
+
+    return d->startStandby(provider);
+}
+
+bool ProviderPluginProxy::prepare(Accounts::Provider provider)
+{
+    Q_D(ProviderPluginProxy);
+
+    if (!provider.isValid()) {
+        qCritical() << " NULL pointer to provider";
+        return false;
+    }
+
+    d->prepare(provider);
+    return true;
+}
+
+void ProviderPluginProxy::setInProcessPluginsEnabled(bool enabled)
+{
+    Q_D(ProviderPluginProxy);
+    d->inProcessEnabled = enabled;
+}
+
+bool ProviderPluginProxy::inProcessPluginsEnabled() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->inProcessEnabled;
+}
+
+void ProviderPluginProxy::setLauncher(Launcher launcher)
+{
+    Q_D(ProviderPluginProxy);
+    d->launcher = launcher;
+}
+
+ProviderPluginProxy::Launcher ProviderPluginProxy::launcher() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->launcher;
+}
+
+void ProviderPluginProxy::setPriority(Priority priority)
+{
+    Q_D(ProviderPluginProxy);
+    d->priority = priority;
+}
+
+ProviderPluginProxy::Priority ProviderPluginProxy::priority() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->priority;
+}
+
+void ProviderPluginProxy::setMaxRunningPlugins(int count)
+{
+    PluginScheduler::instance()->setMaxRunning(count);
+}
+
+int ProviderPluginProxy::maxRunningPlugins()
+{
+    return PluginScheduler::instance()->maxRunning();
+}
+
+void ProviderPluginProxy::setPluginMemoryBudget(qint64 bytes)
+{
+    PluginScheduler::instance()->setMemoryBudget(bytes);
+}
+
+qint64 ProviderPluginProxy::pluginMemoryBudget()
+{
+    return PluginScheduler::instance()->memoryBudget();
+}
+
+void ProviderPluginProxy::setIdlePluginLimit(int count)
+{
+    Q_D(ProviderPluginProxy);
+    d->idlePluginLimit = qMax(count, 0);
+}
+
+int ProviderPluginProxy::idlePluginLimit() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->idlePluginLimit;
+}
+
+void ProviderPluginProxy::setIdlePluginTimeout(int msecs)
+{
+    Q_D(ProviderPluginProxy);
+    d->idlePluginTimeout = qMax(msecs, 0);
+    d->scheduleIdleTimeout();
+}
+
+int ProviderPluginProxy::idlePluginTimeout() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->idlePluginTimeout;
+}
+
+void ProviderPluginProxy::setOutputSink(OutputSink sink,
+                                        const QString &fileName)
+{
+    Q_D(ProviderPluginProxy);
+    d->outputSink = sink;
+    d->outputFileName = fileName;
+}
+
+ProviderPluginProxy::OutputSink ProviderPluginProxy::outputSink() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->outputSink;
+}
+
+void ProviderPluginProxy::setOutputBufferSize(int bytes)
+{
+    Q_D(ProviderPluginProxy);
+    d->outputBufferSize = qMax(bytes, 0);
+}
+
+int ProviderPluginProxy::outputBufferSize() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->outputBufferSize;
+}
+
+void ProviderPluginProxy::setOutputRateLimit(int bytesPerSecond)
+{
+    Q_D(ProviderPluginProxy);
+    d->outputRateLimit = qMax(bytesPerSecond, 0);
+}
+
+int ProviderPluginProxy::outputRateLimit() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->outputRateLimit;
+}
+
+QByteArray ProviderPluginProxy::lastOutput(int maxBytes) const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->lastSession ? d->lastSession->lastOutput(maxBytes) :
+        QByteArray();
+}
+
+void ProviderPluginProxy::setTracingEnabled(bool enabled)
+{
+    Q_D(ProviderPluginProxy);
+    d->tracingEnabled = enabled;
+}
+
+bool ProviderPluginProxy::tracingEnabled() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->tracingEnabled;
+}
+
+QList<ProviderPluginTraceEvent> ProviderPluginProxy::traceEvents() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->traceLog;
+}
+
+void ProviderPluginProxy::clearTraceEvents()
+{
+    Q_D(ProviderPluginProxy);
+    d->traceLog.clear();
+}
+
+bool ProviderPluginProxy::writeChromeTrace(const QString &fileName) const
+{
+    Q_D(const ProviderPluginProxy);
+
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Cannot write trace to" << fileName;
+        return false;
+    }
+
+    /* one instant event per trace point; each session is a thread, so that
+     * the caller and plugin events of a session line up */
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    foreach (const ProviderPluginTraceEvent &event, d->traceLog) {
+        if (!first)
+            out << ",";
+        first = false;
+        out << "\n{\"name\":" << jsonString(event.name)
+            << ",\"cat\":\"" << (event.fromPlugin ? "plugin" : "proxy")
+            << "\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" << event.timestamp
+            << ",\"pid\":" << event.pid
+            << ",\"tid\":" << event.sessionId << "}";
+    }
+    out << "\n]}\n";
+    out.flush();
+
+    return file.error() == QFile::NoError;
+}
+
+ProviderPluginBatch *ProviderPluginProxy::createBatch()
+{
+    Q_D(ProviderPluginProxy);
+    return new ProviderPluginBatch(d, this);
+}
+
+void ProviderPluginProxy::stopStandbyPlugins()
+{
+    Q_D(ProviderPluginProxy);
+
+    QHash<QString, StandbyPlugin>::iterator i;
+    for (i = d->standbyPlugins.begin(); i != d->standbyPlugins.end(); ++i)
+        i->stop();
+    d->standbyPlugins.clear();
+}
+
 QStringList ProviderPluginProxy::pluginDirectories() const
 {
     Q_D(const ProviderPluginProxy);
@@ -297,31 +851,36 @@ QStringList ProviderPluginProxy::pluginDirectories() const
 bool ProviderPluginProxy::accountCreated() const
 {
     Q_D(const ProviderPluginProxy);
-    return d->createdAccountId != 0;
+    return d->lastSession ? d->lastSession->accountCreated() : false;
 }
 
 ProviderPluginProxy::Error ProviderPluginProxy::error() const
 {
     Q_D(const ProviderPluginProxy);
-    return d->error;
+    return d->lastSession ? d->lastSession->error() : NoError;
 }
 
 Accounts::AccountId ProviderPluginProxy::createdAccountId() const
 {
     Q_D(const ProviderPluginProxy);
-    return d->createdAccountId;
+    return d->lastSession ? d->lastSession->createdAccountId() : 0;
 }
 
 bool ProviderPluginProxy::isPluginRunning()
 {
     Q_D(ProviderPluginProxy);
-    return d->process != 0;
+
+    foreach (QPointer<ProviderPluginSession> session, d->runningSessions) {
+        if (!session.isNull() && session->isRunning())
+            return true;
+    }
+    return false;
 }
 
 SetupType ProviderPluginProxy::setupType() const
 {
     Q_D(const ProviderPluginProxy);
-    return d->setupType;
+    return d->lastSession ? d->lastSession->setupType() : Unset;
 }
 
 QString ProviderPluginProxy::pluginName()
@@ -330,7 +889,7 @@ QString ProviderPluginProxy::pluginName()
         return QString();
 
     Q_D(ProviderPluginProxy);
-    return d->pluginName;
+    return d->lastSession ? d->lastSession->pluginName() : QString();
 }
 
 QString ProviderPluginProxy::providerName()
@@ -338,7 +897,19 @@ QString ProviderPluginProxy::providerName()
     if (!isPluginRunning())
         return QString();
     Q_D(ProviderPluginProxy);
-    return d->providerName;
+    return d->lastSession ? d->lastSession->providerName() : QString();
+}
+
+void ProviderPluginProxy::setLaunchParameters(const QVariantMap &parameters)
+{
+    Q_D(ProviderPluginProxy);
+    d->launchParameters = parameters;
+}
+
+QVariantMap ProviderPluginProxy::launchParameters() const
+{
+    Q_D(const ProviderPluginProxy);
+    return d->launchParameters;
 }
 
 void ProviderPluginProxy::setAdditionalParameters(const QStringList &parameters)
@@ -357,20 +928,28 @@ bool ProviderPluginProxy::killRunningPlugin()
 {
     Q_D(ProviderPluginProxy);
 
-    if (d->process == 0)
-        return false;
+    bool killed = false;
+    foreach (QPointer<ProviderPluginSession> session, d->runningSessions) {
+        if (session.isNull())
+            continue;
 
-    d->process->disconnect();
-    d->process->close();
-    delete d->process;
-    d->process = 0;
+        if (session->isRunning()) {
+            session->d_func()->kill();
+            killed = true;
+        }
+    }
+    d->runningSessions.clear();
 
-    return true;
+    return killed;
 }
 
 QVariant ProviderPluginProxy::exitData()
 {
     Q_D(ProviderPluginProxy);
-    return d->exitData;
+    return d->lastSession ? d->lastSession->exitData() : QVariant();
 }
 
+QVariantMap ProviderPluginProxy::metrics()
+{
+    return PluginMetrics::snapshot();
+}
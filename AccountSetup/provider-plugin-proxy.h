@@ -36,14 +36,21 @@
 #include <Accounts/Provider>
 
 // Qt
+#include <QFuture>
+#include <QList>
 #include <QObject>
 #include <QStringList>
+#include <QVariantMap>
 
 class QWidget;
 
 namespace AccountSetup {
 
+class ProviderPluginBatch;
 class ProviderPluginProxyPrivate;
+class ProviderPluginResult;
+class ProviderPluginSession;
+struct ProviderPluginTraceEvent;
 
 /*!
  * @class ProviderPluginProxy
@@ -54,8 +61,13 @@ class ProviderPluginProxyPrivate;
  * @details The ProviderPluginProxy class can be used to run the account
  * plugins. Plugins can be started with the createAccount() and editAccount()
  * methods, respectively to enter the account creation and editing modes.
- * Plugin lifetime can be monitored with the created(), edited(), cancelled()
- * signals, or inspected with the isPluginRunning() method.
+ * Each call returns a ProviderPluginSession, and several plugins can be
+ * running at the same time. Plugin lifetime can be monitored with the
+ * finished() signals, or inspected with the isPluginRunning() method.
+ *
+ * The accessors of this class which describe a plugin execution, such as
+ * error() and createdAccountId(), refer to the session which was started
+ * last.
  */
 class ACCOUNTSETUP_EXPORT ProviderPluginProxy: public QObject
 {
@@ -63,7 +75,9 @@ class ACCOUNTSETUP_EXPORT ProviderPluginProxy: public QObject
 
 public:
     /*!
-     * Error codes for plugin execution.
+     * Error codes for plugin execution. ResultLost means that the plugin
+     * did send a result, but that it could not be read, for example
+     * because the shared memory carrying it was invalid.
      * @sa error()
      */
     enum Error {
@@ -71,6 +85,48 @@ public:
         AccountNotFound,
         PluginNotFound,
         PluginCrashed,
+        Cancelled,
+        ResultLost
+    };
+
+    /*!
+     * Where the standard output and error of the plugin processes go.
+     * @sa setOutputSink()
+     */
+    enum OutputSink {
+        /*! The output is only kept for lastOutput(). */
+        DiscardOutput = 0,
+        /*! The output is logged with qDebug(). */
+        LogOutput,
+        /*! The output is appended to a file. */
+        FileOutput,
+        /*! The output is emitted by ProviderPluginSession. */
+        SignalOutput
+    };
+
+    /*!
+     * How the plugin processes are created.
+     * @sa setLauncher()
+     */
+    enum Launcher {
+        /*! With QProcess, which forks this process. */
+        ForkLauncher = 0,
+        /*! With posix_spawn(), which doesn't copy the memory mappings of
+         * this process: faster when this process is large. */
+        SpawnLauncher
+    };
+
+    /*!
+     * Which plugin launches go first, when they have to wait for the
+     * others to finish.
+     * @sa setPriority(), setMaxRunningPlugins()
+     */
+    enum Priority {
+        /*! For plugins which the user is waiting for. */
+        InteractivePriority = 0,
+        /*! For plugins run on the user's behalf, such as those of a
+         * ProviderPluginBatch. */
+        BackgroundPriority
     };
 
     /*!
@@ -85,9 +141,12 @@ public:
      * @param provider The Accounts::Provider for the account to be created.
      * @param serviceType The main service type the user is interested in, or
      * empty string.
+     *
+     * @return The session for this plugin execution, owned by the caller:
+     * see ProviderPluginSession.
      */
-    void createAccount(Accounts::Provider provider,
-                       const QString &serviceType);
+    ProviderPluginSession *createAccount(Accounts::Provider provider,
+                                         const QString &serviceType);
 
     /*!
      * Runs the account plugin to edit an account.
@@ -95,8 +154,49 @@ public:
      * @param account The Accounts::Account to be edited.
      * @param serviceType The main service type the user is interested in, or
      * empty string.
+     *
+     * @return The session for this plugin execution, owned by the caller:
+     * see ProviderPluginSession.
      */
-    void editAccount(Accounts::Account *account, const QString &serviceType);
+    ProviderPluginSession *editAccount(Accounts::Account *account,
+                                       const QString &serviceType);
+
+    /*!
+     * Runs the account plugin to create an account, like createAccount(),
+     * and returns a future which gets the result. This can be called from
+     * any thread: the plugin is started from the event loop of the thread
+     * of this object, which must be running, and the caller can block on
+     * the future without running an event loop of its own.
+     * @note Blocking on the future from the thread of this object would
+     * never return; use a QFutureWatcher there.
+     * @note ProviderPluginResult is declared in
+     * AccountSetup/ProviderPluginBatch.
+     *
+     * @param provider The Accounts::Provider for the account to be created.
+     * @param serviceType The main service type the user is interested in, or
+     * empty string.
+     *
+     * @return The future result of this plugin execution.
+     */
+    QFuture<ProviderPluginResult>
+        createAccountAsync(Accounts::Provider provider,
+                           const QString &serviceType);
+
+    /*!
+     * Runs the account plugin to edit an account, like editAccount(), and
+     * returns a future which gets the result.
+     * @sa createAccountAsync()
+     *
+     * @param account The Accounts::Account to be edited; it must not be
+     * deleted before the plugin has been started.
+     * @param serviceType The main service type the user is interested in, or
+     * empty string.
+     *
+     * @return The future result of this plugin execution.
+     */
+    QFuture<ProviderPluginResult>
+        editAccountAsync(Accounts::Account *account,
+                         const QString &serviceType);
 
     /*!
      * Attempt to set the next executed account plugin modal to a given widget.
@@ -112,6 +212,278 @@ public:
      */
     void setPluginDirectories(const QStringList &pluginDirs);
 
+    /*!
+     * Sets parameters to be passed to the plugin on the next invocations
+     * of createAccount() or editAccount(). The plugin gets them from
+     * ProviderPluginProcess::parameters(); their meaning depends on the
+     * plugin.
+     * @param parameters The parameters, of any size.
+     */
+    void setLaunchParameters(const QVariantMap &parameters);
+
+    /*!
+     * @return The parameters passed to the plugins at launch.
+     */
+    QVariantMap launchParameters() const;
+
+    /*!
+     * Sets how long to wait for the plugin to send more of its result,
+     * once it has started sending it. The result is read without blocking,
+     * so this only limits how long a stalled plugin can delay the finished()
+     * signal. The default is 10 seconds.
+     * @param msecs The timeout in milliseconds, or 0 to wait forever.
+     */
+    void setResultTimeout(int msecs);
+
+    /*!
+     * @return The timeout for receiving the plugin result, in milliseconds.
+     */
+    int resultTimeout() const;
+
+    /*!
+     * Starts the plugin for the given provider in standby mode: the process
+     * is started and initialized in advance, and then waits until the next
+     * createAccount() or editAccount() for a provider handled by the same
+     * plugin hands it the launch parameters. This hides most of the process
+     * startup time from the user.
+     * @param provider The Accounts::Provider whose plugin should be started.
+     *
+     * @return Returns true if a standby plugin is running or being started.
+     */
+    bool startStandbyPlugin(Accounts::Provider provider);
+
+    /*!
+     * Looks up the plugin for the given provider in a worker thread, and
+     * asks the kernel to read the plugin and the libraries it links to
+     * into memory. Unlike startStandbyPlugin() no process is started: this
+     * is cheap enough to be called whenever a provider is shown to the
+     * user, and makes the following createAccount() or editAccount()
+     * faster on a cold start.
+     * @param provider The Accounts::Provider whose plugin will be used.
+     *
+     * @return Returns false if the provider is not valid.
+     */
+    bool prepare(Accounts::Provider provider);
+
+    /*!
+     * Enables loading the plugins which support it as shared libraries,
+     * running them in this process instead of starting their executable.
+     * Only plugins declared by their provider file as able to run
+     * in-process are affected. It's disabled by default, since in-process
+     * plugins share the memory and the main thread of the caller.
+     * @sa ProviderPluginInterface
+     * @param enabled Whether to run plugins in-process when possible.
+     */
+    void setInProcessPluginsEnabled(bool enabled);
+
+    /*!
+     * @return Whether plugins are run in-process when possible.
+     */
+    bool inProcessPluginsEnabled() const;
+
+    /*!
+     * Sets how the plugin processes are started. Either way, the plugins
+     * get the same arguments and descriptors, and their exit status and
+     * output are reported in the same way. The default is ForkLauncher.
+     * @param launcher The way to start the plugin processes.
+     */
+    void setLauncher(Launcher launcher);
+
+    /*!
+     * @return How the plugin processes are started.
+     */
+    Launcher launcher() const;
+
+    /*!
+     * Sets the priority of the plugins started by createAccount() and
+     * editAccount(), when they have to wait for a free slot; the jobs of a
+     * ProviderPluginBatch always have the BackgroundPriority. The default
+     * is InteractivePriority.
+     * @sa setMaxRunningPlugins()
+     * @param priority The priority of the next launches.
+     */
+    void setPriority(Priority priority);
+
+    /*!
+     * @return The priority of the plugins started by this object.
+     */
+    Priority priority() const;
+
+    /*!
+     * Limits how many plugin processes can run at the same time in this
+     * process, whichever ProviderPluginProxy started them. Launches beyond
+     * the limit wait in a queue: those with InteractivePriority go first,
+     * and the proxies take turns within each priority. The session of a
+     * waiting plugin is already returned, and is reported as running; the
+     * time spent waiting is given by ProviderPluginSession::queueTime().
+     * Plugins in standby or idle in server mode don't count.
+     * @param count The limit, or 0 (the default) for no limit.
+     */
+    static void setMaxRunningPlugins(int count);
+
+    /*!
+     * @return How many plugin processes can run at the same time.
+     */
+    static int maxRunningPlugins();
+
+    /*!
+     * Limits the memory that the plugin processes running at the same time
+     * can use, in the same way as setMaxRunningPlugins(). The memory a
+     * plugin needs is the peak seen in its previous runs, or 32 MB until
+     * it has run once; a plugin needing more than the budget still runs,
+     * when no other is running.
+     * @param bytes The budget, or 0 (the default) for no limit.
+     */
+    static void setPluginMemoryBudget(qint64 bytes);
+
+    /*!
+     * @return The memory budget of the plugin processes, in bytes.
+     */
+    static qint64 pluginMemoryBudget();
+
+    /*!
+     * Enables the server mode of the plugins, which lets a plugin process
+     * handle several requests: when it has delivered the result of one, it
+     * waits for the next, so that another createAccount() or editAccount()
+     * for a provider handled by the same plugin skips the process startup.
+     * Only plugins which support it are kept; see
+     * ProviderPluginProcess::requestReceived().
+     * The waiting processes share a pool with those started by
+     * startStandbyPlugin(): at most one process is kept for each plugin,
+     * and up to @a count in all, stopping those which have waited the
+     * longest when the pool is full.
+     * @sa setIdlePluginTimeout(), stopStandbyPlugins()
+     * @param count How many processes to keep, or 0 (the default) to
+     * disable the server mode.
+     */
+    void setIdlePluginLimit(int count);
+
+    /*!
+     * @return How many plugin processes are kept waiting for a request.
+     */
+    int idlePluginLimit() const;
+
+    /*!
+     * Sets how long the plugin processes waiting in the pool, either idle
+     * in server mode or started by startStandbyPlugin(), are kept before
+     * they are stopped. The default is one minute.
+     * @param msecs The timeout, or 0 to keep them until
+     * stopStandbyPlugins() is called.
+     */
+    void setIdlePluginTimeout(int msecs);
+
+    /*!
+     * @return How long the plugin processes wait in the pool.
+     */
+    int idlePluginTimeout() const;
+
+    /*!
+     * Sets where the standard output and error of the plugins go, from
+     * the next invocation of createAccount() or editAccount(). Whatever the
+     * sink, the last bytes are kept by each session. The default is
+     * LogOutput.
+     * @sa setOutputRateLimit(), lastOutput()
+     * @param sink The output sink.
+     * @param fileName The file to append the output to, for FileOutput.
+     */
+    void setOutputSink(OutputSink sink, const QString &fileName = QString());
+
+    /*!
+     * @return The output sink for the plugins.
+     */
+    OutputSink outputSink() const;
+
+    /*!
+     * Sets how many bytes of the plugin output are kept by each session.
+     * The default is 64 KiB.
+     * @param bytes The buffer size, or 0 to keep nothing.
+     */
+    void setOutputBufferSize(int bytes);
+
+    /*!
+     * @return How many bytes of the plugin output are kept by each session.
+     */
+    int outputBufferSize() const;
+
+    /*!
+     * Limits how much plugin output goes to the sink; the excess is only
+     * kept in the session buffer. The default is 16 KiB per second for each
+     * session.
+     * @param bytesPerSecond The limit, or 0 for no limit.
+     */
+    void setOutputRateLimit(int bytesPerSecond);
+
+    /*!
+     * @return The limit of the plugin output going to the sink, in bytes
+     * per second.
+     */
+    int outputRateLimit() const;
+
+    /*!
+     * Gets the last bytes written by the plugin executed last, for
+     * instance to find out why it crashed.
+     * @param maxBytes How many bytes to return at most, or -1 for all
+     * those kept.
+     * @sa ProviderPluginSession::lastOutput()
+     *
+     * @return The last bytes of the output of the plugin.
+     */
+    QByteArray lastOutput(int maxBytes = -1) const;
+
+    /*!
+     * Enables recording the timing of the plugin executions, from the call
+     * to createAccount() or editAccount() to the finished() signal, with
+     * the startup phases of the plugin process in between. Only sessions
+     * started while tracing is enabled are traced. It's disabled by
+     * default.
+     * @sa ProviderPluginSession::traceEvents(),
+     * ProviderPluginProcess::reportUiReady()
+     * @param enabled Whether to trace the plugin executions.
+     */
+    void setTracingEnabled(bool enabled);
+
+    /*!
+     * @return Whether the plugin executions are being traced.
+     */
+    bool tracingEnabled() const;
+
+    /*!
+     * @return The trace events of the traced sessions which have finished,
+     * in order of completion. Only the most recent events are kept.
+     */
+    QList<ProviderPluginTraceEvent> traceEvents() const;
+
+    /*!
+     * Discards the trace events collected so far.
+     */
+    void clearTraceEvents();
+
+    /*!
+     * Writes the collected trace events to a file, in the JSON format used
+     * by the Chrome trace viewer.
+     * @param fileName The file to write.
+     *
+     * @return Whether the file has been written.
+     */
+    bool writeChromeTrace(const QString &fileName) const;
+
+    /*!
+     * Creates a batch, to run the plugins for several accounts at once.
+     * The batch is owned by this object, and can be deleted once it has
+     * finished.
+     * @sa ProviderPluginBatch
+     *
+     * @return A new, empty batch.
+     */
+    ProviderPluginBatch *createBatch();
+
+    /*!
+     * Terminates all the plugin processes started with
+     * startStandbyPlugin() which haven't been used yet, and those waiting
+     * for a request in server mode.
+     */
+    void stopStandbyPlugins();
+
     /*!
      * Get the list of directories which will be searched for provider
      * plugins.
@@ -145,7 +517,8 @@ public:
     /*!
      * Checks whether a plugin is running.
      *
-     * @return Returns true if there is plugin process running.
+     * @return Returns true if any plugin process started by this object is
+     * running.
      */
     bool isPluginRunning();
 
@@ -173,6 +546,32 @@ public:
      */
     QVariant exitData();
 
+    /*!
+     * Returns what the plugin executions of the whole process have been
+     * like so far, whichever ProviderPluginProxy started them. The map
+     * has three keys:
+     * - "total": the statistics of all the executions;
+     * - "providers": a map from each provider name to its statistics;
+     * - "plugins": a map from each plugin name to its statistics.
+     *
+     * The statistics are maps with the counters "launches", and one per
+     * outcome: "succeeded", "accountNotFound", "pluginNotFound",
+     * "pluginCrashed", "failedToStart", "cancelled", "resultLost" and
+     * "other", for any error without a counter of its own. They also
+     * hold the histograms "queueTime", the time spent waiting for a free
+     * slot, and "duration", from then to the end of the execution, both
+     * in milliseconds, and "payloadSize", the size in bytes of the result
+     * of the successful executions. A histogram holds its "count", "max",
+     * the percentiles "p50", "p90" and "p99" and the "buckets", a map
+     * from the upper bound of each power-of-two bucket to the number of
+     * values in it; the percentiles are the upper bound of their bucket.
+     *
+     * Recording the statistics takes no locks, so they are always
+     * collected.
+     * @return A snapshot of the statistics.
+     */
+    static QVariantMap metrics();
+
 Q_SIGNALS:
     /*!
      * Emitted when the plugin execution has been completed.
@@ -180,14 +579,32 @@ Q_SIGNALS:
      */
     void finished();
 
+    /*!
+     * Emitted when the plugin execution for @a session has been completed,
+     * right before the finished() signal without arguments.
+     * @param session The session which has finished.
+     */
+    void finished(AccountSetup::ProviderPluginSession *session);
+
+    /*!
+     * Emitted as soon as a plugin has stored an account, before the plugin
+     * has terminated; the account can already be loaded, for instance to
+     * start synchronizing it.
+     * @sa ProviderPluginSession::accountReady()
+     * @param accountId The ID of the created or edited account.
+     */
+    void accountReady(Accounts::AccountId accountId);
+
 protected:
     /*!
      * Sets additional parameters to be passed to the plugin process on the
      * next invocation of createAccount() or editAccount().
      *
      * @param parameters The additional parameters to be passed to the plugin.
-     * In the current implementation these parameters are passed as process
-     * arguments.
+     * The plugin gets them from ProviderPluginProcess::arguments(). They
+     * are also passed as process arguments, except to plugins started with
+     * startStandbyPlugin() or reused in server mode, which were already
+     * running.
      */
     void setAdditionalParameters(const QStringList &parameters);
 
@@ -197,10 +614,12 @@ protected:
     QStringList additionalParameters() const;
 
     /*!
-     * Kills the plugin being executed. This will probably result in data loss
-     * and other resource waste, so it's strongly recommended not to ever call
-     * this method.
-     * @return Returns true is the process was terminated, false otherwise.
+     * Kills the plugins being executed. This will probably result in data
+     * loss and other resource waste, so it's strongly recommended not to ever
+     * call this method; ProviderPluginSession::cancel() gives the plugins a
+     * chance to terminate cleanly. This method doesn't wait for the plugin
+     * processes to exit.
+     * @return Returns true is any process was terminated, false otherwise.
      */
     bool killRunningPlugin();
 
@@ -0,0 +1,213 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#ifndef ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_PRIV_H
+#define ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_PRIV_H
+
+//libAccountSetup
+#include "plugin-launch.h"
+#include "plugin-metrics.h"
+#include "plugin-output.h"
+#include "provider-plugin-batch.h"
+#include "provider-plugin-session.h"
+
+//Qt
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFutureInterface>
+#include <QMutex>
+#include <QPointer>
+#include <QProcess>
+#include <QTimer>
+#include <QWaitCondition>
+
+namespace AccountSetup {
+
+class PluginChannel;
+class PluginLauncher;
+class ProviderPluginProcess;
+class ProviderPluginProxyPrivate;
+
+/* A plugin process waiting for its launch parameters: started in advance,
+ * or done with a previous request in server mode */
+struct StandbyPlugin
+{
+    StandbyPlugin(): process(0), channel(0) {}
+
+    void stop();
+
+    PluginLauncher *process;
+    PluginChannel *channel;
+    /* for the LRU eviction and the idle timeout */
+    QElapsedTimer idleSince;
+};
+
+class ProviderPluginSessionPrivate: public QObject
+{
+    Q_OBJECT
+    Q_DECLARE_PUBLIC(ProviderPluginSession)
+
+public:
+    ProviderPluginSessionPrivate(ProviderPluginSession *parent):
+        q_ptr(parent),
+        pluginName(),
+        process(0),
+        hostedPlugin(0),
+        channel(0),
+        resultTimeout(0),
+        processFinished(false),
+        createdAccountId(0),
+        error(ProviderPluginProxy::NoError),
+        sharedResult(0),
+        sharedResultSize(0),
+        resultLost(false),
+        setupType(Unset),
+        providerName(),
+        exitData(),
+        tracing(false),
+        sessionId(0),
+        outputSink(ProviderPluginProxy::LogOutput),
+        launcher(ProviderPluginProxy::ForkLauncher),
+        cancelling(false),
+        terminated(false),
+        done(false),
+        serverMode(false),
+        resultReceived(false),
+        failedToStart(false),
+        resultSize(0),
+        resultDecoded(false),
+        accountAnnounced(false),
+        scheduled(false),
+        queued(false),
+        queuedAt(0),
+        queueTime(0)
+    {
+        elapsed.start();
+        cancelTimer.setSingleShot(true);
+        connect(&cancelTimer, SIGNAL(timeout()),
+                this, SLOT(onCancelTimeout()));
+    }
+    ~ProviderPluginSessionPrivate();
+
+    bool schedule(ProviderPluginProxy::Priority priority, const void *owner);
+    void unschedule();
+    qint64 timeInQueue() const;
+    void start(const QString &processName, const QStringList &arguments,
+               const PluginLaunch &launch);
+    bool startHosted(const QString &libraryPath, Accounts::Manager *manager,
+                     const PluginLaunch &launch);
+    void startStandby(StandbyPlugin &standby, const PluginLaunch &launch);
+    void attachChannel(PluginChannel *pluginChannel);
+    void finish(ProviderPluginProxy::Error error);
+    void kill();
+    void cancel(int timeout);
+    void sendToPlugin(int type, const QByteArray &payload);
+    void trace(const char *name);
+    void setOutputSink(ProviderPluginProxy::OutputSink sink,
+                       const QString &fileName);
+    void addFuture(QFutureInterface<ProviderPluginResult> future);
+    ProviderPluginResult result() const;
+
+private Q_SLOTS:
+    void onReadOutput();
+    void onError(QProcess::ProcessError);
+    void onFinished(int exitCode, QProcess::ExitStatus exitStatus);
+    void onMessageReceived(int type, const QByteArray &payload);
+    void onHostedMessage(int type, const QByteArray &payload);
+    void onChannelClosed();
+    void onCancelTimeout();
+    void onLaunchGranted();
+
+private:
+    void onPluginIdle();
+    void decodeResult();
+    void recordMemoryUsage();
+    void announceAccount(Accounts::AccountId accountId);
+    void connectProcess();
+    void sendLaunch(const PluginLaunch &launch);
+    void releaseProcess();
+    void closeChannel();
+    void receiveSharedResult(const QByteArray &payload);
+    void receiveTrace(const QByteArray &payload);
+    void releaseSharedResult();
+    void deliverResult();
+
+    mutable ProviderPluginSession *q_ptr;
+    friend class ProviderPluginProxyPrivate;
+    QString pluginName;
+    PluginLauncher *process;
+    ProviderPluginProcess *hostedPlugin;
+    PluginChannel *channel;
+    int resultTimeout;
+    bool processFinished;
+    Accounts::AccountId createdAccountId;
+    ProviderPluginProxy::Error error;
+    QByteArray pluginOutput;
+    void *sharedResult;
+    size_t sharedResultSize;
+    /* the plugin sent a result which could not be read */
+    bool resultLost;
+    SetupType setupType;
+    QString providerName;
+    QString serviceType;
+    QVariant exitData;
+    bool tracing;
+    int sessionId;
+    QList<ProviderPluginTraceEvent> traceEvents;
+    PluginOutputBuffer output;
+    PluginOutputLimiter outputLimiter;
+    ProviderPluginProxy::OutputSink outputSink;
+    QFile outputFile;
+    ProviderPluginProxy::Launcher launcher;
+    bool cancelling;
+    bool terminated;
+    QTimer cancelTimer;
+    QElapsedTimer elapsed;
+    /* for waitForFinished() from other threads */
+    mutable QMutex doneMutex;
+    QWaitCondition doneCondition;
+    bool done;
+    QList<QFutureInterface<ProviderPluginResult> > futures;
+    /* whether the plugin can be given back to the proxy when idle */
+    bool serverMode;
+    bool resultReceived;
+    QString pluginPath;
+    QPointer<ProviderPluginProxyPrivate> proxy;
+    PluginMetrics metrics;
+    bool failedToStart;
+    int resultSize;
+    bool resultDecoded;
+    bool accountAnnounced;
+    /* what the process is started with, when the scheduler allows it */
+    bool scheduled;
+    bool queued;
+    qint64 queuedAt;
+    qint64 queueTime;
+    QString scheduledPath;
+    QStringList scheduledArguments;
+    PluginLaunch scheduledLaunch;
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_PRIV_H
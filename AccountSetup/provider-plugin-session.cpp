@@ -0,0 +1,863 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+#include "provider-plugin-session.h"
+#include "provider-plugin-session-priv.h"
+#include "plugin-channel.h"
+#include "plugin-launcher.h"
+#include "plugin-reaper.h"
+#include "plugin-scheduler.h"
+#include "plugin-trace.h"
+#include "provider-plugin-interface.h"
+#include "provider-plugin-process-priv.h"
+#include "provider-plugin-proxy-priv.h"
+
+#include <QCoreApplication>
+#include <QDataStream>
+#include <QDebug>
+#include <QPluginLoader>
+#include <QThread>
+
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+/* how long a standby plugin gets to exit on its own */
+static const int standbyExitTimeout = 2000;
+
+/* the result of a plugin which sent the user to the accounts page */
+static const int cancelledAccountId = -1;
+
+void StandbyPlugin::stop()
+{
+    /* the plugin exits as soon as it sees the channel closed */
+    delete channel;
+
+    if (process)
+        PluginReaper::instance()->reap(process, standbyExitTimeout);
+    *this = StandbyPlugin();
+}
+
+ProviderPluginSessionPrivate::~ProviderPluginSessionPrivate()
+{
+    qDebug() << Q_FUNC_INFO;
+    if (process)
+        PluginReaper::instance()->reap(process);
+    releaseSharedResult();
+
+    /* a plugin dropped along with its session counts as cancelled */
+    if (!done)
+        metrics.finished(ProviderPluginProxy::Cancelled, false,
+                         timeInQueue(), elapsed.elapsed() - timeInQueue(), 0);
+    unschedule();
+
+    /* nobody must be left waiting for a plugin which was killed */
+    if (!futures.isEmpty()) {
+        error = ProviderPluginProxy::Cancelled;
+        ProviderPluginResult cancelled = result();
+        foreach (QFutureInterface<ProviderPluginResult> future, futures) {
+            future.reportResult(cancelled);
+            future.reportFinished();
+        }
+    }
+}
+
+void ProviderPluginSessionPrivate::connectProcess()
+{
+    /* stdout and stderr are merged by the process */
+    connect(process, SIGNAL(readyReadStandardOutput()),
+            this, SLOT(onReadOutput()));
+    connect(process, SIGNAL(error(QProcess::ProcessError)),
+            this, SLOT(onError(QProcess::ProcessError)));
+    connect(process, SIGNAL(finished(int, QProcess::ExitStatus)),
+            this, SLOT(onFinished(int, QProcess::ExitStatus)));
+}
+
+bool ProviderPluginSessionPrivate::schedule(
+                                    ProviderPluginProxy::Priority priority,
+                                    const void *owner)
+{
+    scheduled = true;
+    if (PluginScheduler::instance()->submit(this, priority, owner,
+                                            pluginName))
+        return true;
+
+    queued = true;
+    queuedAt = elapsed.elapsed();
+    trace("launch-queued");
+    return false;
+}
+
+void ProviderPluginSessionPrivate::unschedule()
+{
+    queued = false;
+    if (!scheduled)
+        return;
+
+    /* let the next plugin in */
+    scheduled = false;
+    PluginScheduler::instance()->release(this);
+}
+
+qint64 ProviderPluginSessionPrivate::timeInQueue() const
+{
+    return queued ? elapsed.elapsed() - queuedAt : queueTime;
+}
+
+void ProviderPluginSessionPrivate::onLaunchGranted()
+{
+    if (!queued)
+        return;
+
+    queueTime = timeInQueue();
+    queued = false;
+    trace("launch-granted");
+
+    if (proxy.isNull()) {
+        finish(ProviderPluginProxy::Cancelled);
+        return;
+    }
+    proxy->startScheduled(this);
+}
+
+void ProviderPluginSessionPrivate::start(const QString &processName,
+                                         const QStringList &arguments,
+                                         const PluginLaunch &launch)
+{
+    qDebug() << Q_FUNC_INFO << processName << arguments << launch.arguments;
+
+    PluginLauncher *pluginProcess = PluginLauncher::create(launcher, this);
+    process = pluginProcess;
+    connectProcess();
+    metrics.launched();
+
+    /* Without a channel, the plugin won't get the launch message: it exits
+     * with an error, and the session finishes as usual. The task is on the
+     * command line too, right after --launch, for the plugins which parse
+     * it there. */
+    trace("process-start");
+    PluginChannel *pluginChannel =
+        pluginProcess->startWithChannel(processName,
+                                        QStringList() << arguments <<
+                                        QLatin1String("--launch") <<
+                                        launch.arguments);
+    if (pluginChannel == 0)
+        return;
+    trace("process-spawned");
+
+    /* the process might have failed already */
+    if (process != 0) {
+        attachChannel(pluginChannel);
+        sendLaunch(launch);
+    } else {
+        delete pluginChannel;
+    }
+}
+
+void ProviderPluginSessionPrivate::sendLaunch(const PluginLaunch &launch)
+{
+    /* It's read as soon as the plugin has opened the channel, or, for a
+     * plugin in standby, when it's done initializing. */
+    channel->sendMessage(PluginChannel::Launch, launch.encode());
+    trace("launch-sent");
+}
+
+bool ProviderPluginSessionPrivate::startHosted(const QString &libraryPath,
+                                               Accounts::Manager *manager,
+                                               const PluginLaunch &launch)
+{
+    qDebug() << Q_FUNC_INFO << libraryPath << launch.arguments;
+
+    /* the library stays loaded: there's no telling when the plugin is
+     * done with it */
+    QPluginLoader loader(libraryPath);
+    ProviderPluginInterface *plugin =
+        qobject_cast<ProviderPluginInterface *>(loader.instance());
+    if (plugin == 0) {
+        qWarning() << "Cannot load plugin:" << loader.errorString();
+        return false;
+    }
+    trace("plugin-loaded");
+
+    hostedPlugin = new ProviderPluginProcess(manager, launch, this);
+    /* queued, so that the plugin is never deleted from within its own
+     * calls, and that the results arrive from the event loop just like
+     * those of a plugin process */
+    connect(hostedPlugin->d_func(),
+            SIGNAL(hostMessage(int, const QByteArray &)),
+            this, SLOT(onHostedMessage(int, const QByteArray &)),
+            Qt::QueuedConnection);
+    /* what the plugin traced while being constructed */
+    hostedPlugin->d_func()->flushTrace();
+
+    trace("hosted-start");
+    metrics.launched();
+    plugin->start(hostedPlugin);
+    return true;
+}
+
+void ProviderPluginSessionPrivate::onHostedMessage(int type,
+                                                   const QByteArray &payload)
+{
+    if (hostedPlugin == 0)
+        return;
+
+    onMessageReceived(type, payload);
+    if (type != PluginChannel::Result)
+        return;
+
+    hostedPlugin->deleteLater();
+    hostedPlugin = 0;
+    pluginName.clear();
+    processFinished = true;
+    deliverResult();
+}
+
+void ProviderPluginSessionPrivate::startStandby(StandbyPlugin &standby,
+                                                const PluginLaunch &launch)
+{
+    qDebug() << Q_FUNC_INFO << launch.arguments;
+
+    process = standby.process;
+    process->disconnect();
+    process->setParent(this);
+    connectProcess();
+    metrics.launched();
+
+    PluginChannel *pluginChannel = standby.channel;
+    standby = StandbyPlugin();
+
+    if (pluginChannel != 0) {
+        pluginChannel->disconnect();
+        attachChannel(pluginChannel);
+        sendLaunch(launch);
+    }
+}
+
+void ProviderPluginSessionPrivate::attachChannel(PluginChannel *pluginChannel)
+{
+    channel = pluginChannel;
+    channel->setParent(this);
+    channel->setTimeout(resultTimeout);
+    connect(channel, SIGNAL(messageReceived(int, const QByteArray &)),
+            this, SLOT(onMessageReceived(int, const QByteArray &)));
+    connect(channel, SIGNAL(disconnected()), this, SLOT(onChannelClosed()));
+    connect(channel, SIGNAL(timedOut()), this, SLOT(onChannelClosed()));
+}
+
+void ProviderPluginSessionPrivate::onMessageReceived(int type,
+                                                     const QByteArray &payload)
+{
+    Q_Q(ProviderPluginSession);
+
+    switch (type) {
+    case PluginChannel::Result:
+        /* nothing else is expected after the result, but a plugin in server
+         * mode telling that it can take another request */
+        trace("result-received");
+        pluginOutput = payload;
+        recordMemoryUsage();
+        decodeResult();
+        resultReceived = true;
+        if (!serverMode)
+            onChannelClosed();
+        break;
+    case PluginChannel::SharedResult:
+        trace("result-received");
+        receiveSharedResult(payload);
+        recordMemoryUsage();
+        decodeResult();
+        resultReceived = true;
+        if (!serverMode)
+            onChannelClosed();
+        break;
+    case PluginChannel::Idle:
+        onPluginIdle();
+        break;
+    case PluginChannel::AccountReady:
+        announceAccount(PluginChannel::toVariant(payload).toUInt());
+        break;
+    case PluginChannel::Trace:
+        receiveTrace(payload);
+        break;
+    case PluginChannel::Progress:
+        emit q->progressReported(PluginChannel::toVariant(payload));
+        break;
+    case PluginChannel::PartialResult:
+        emit q->partialResultReceived(PluginChannel::toVariant(payload));
+        break;
+    default:
+        qWarning() << "Unexpected message from plugin:" << type;
+    }
+}
+
+void ProviderPluginSessionPrivate::onPluginIdle()
+{
+    if (!resultReceived || process == 0 || channel == 0)
+        return;
+
+    /* the process outlives the session, in the pool of the proxy */
+    trace("plugin-idle");
+    StandbyPlugin idle;
+    idle.process = process;
+    idle.channel = channel;
+    process->disconnect(this);
+    channel->disconnect(this);
+    process = 0;
+    channel = 0;
+    pluginName.clear();
+
+    if (proxy.isNull())
+        idle.stop();
+    else
+        proxy->addIdle(pluginPath, idle);
+
+    processFinished = true;
+    deliverResult();
+}
+
+void ProviderPluginSessionPrivate::receiveSharedResult(const QByteArray &payload)
+{
+    quint64 size = 0;
+    QDataStream stream(payload);
+    stream >> size;
+
+    int fd = channel->receiveDescriptor();
+    if (fd < 0) {
+        qWarning() << "Shared result not received";
+        resultLost = true;
+        return;
+    }
+
+    /* The plugin could otherwise still modify the buffer, or truncate it
+     * and make us crash while reading it. */
+    bool valid = false;
+#ifdef F_GET_SEALS
+    const int requiredSeals = F_SEAL_SHRINK | F_SEAL_WRITE;
+    int seals = ::fcntl(fd, F_GET_SEALS);
+    struct stat info;
+    valid = seals >= 0 && (seals & requiredSeals) == requiredSeals &&
+        ::fstat(fd, &info) == 0 && quint64(info.st_size) >= size &&
+        size > 0 && size <= quint64(INT_MAX);
+#endif
+
+    void *data = MAP_FAILED;
+    if (valid)
+        data = ::mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (data == MAP_FAILED) {
+        qWarning() << "Invalid shared result";
+        resultLost = true;
+        return;
+    }
+
+    /* read in place, without copying it out of the mapping */
+    releaseSharedResult();
+    sharedResult = data;
+    sharedResultSize = size;
+    pluginOutput = QByteArray::fromRawData(static_cast<const char *>(data),
+                                           int(size));
+}
+
+void ProviderPluginSessionPrivate::receiveTrace(const QByteArray &payload)
+{
+    if (!tracing)
+        return;
+
+    qint64 pid;
+    QList<PluginTracePoint> points;
+    if (!PluginTrace::decode(payload, pid, points)) {
+        qWarning() << "Invalid trace from plugin";
+        return;
+    }
+
+    foreach (const PluginTracePoint &point, points) {
+        ProviderPluginTraceEvent event;
+        event.name = point.first;
+        event.fromPlugin = true;
+        event.pid = pid;
+        event.sessionId = sessionId;
+        event.timestamp = point.second;
+        traceEvents.append(event);
+    }
+}
+
+void ProviderPluginSessionPrivate::trace(const char *name)
+{
+    if (!tracing)
+        return;
+
+    ProviderPluginTraceEvent event;
+    event.name = QString::fromLatin1(name);
+    event.fromPlugin = false;
+    event.pid = QCoreApplication::applicationPid();
+    event.sessionId = sessionId;
+    event.timestamp = PluginTrace::timestamp();
+    traceEvents.append(event);
+}
+
+void ProviderPluginSessionPrivate::releaseSharedResult()
+{
+    if (sharedResult == 0)
+        return;
+
+    pluginOutput.clear();
+    ::munmap(sharedResult, sharedResultSize);
+    sharedResult = 0;
+    sharedResultSize = 0;
+}
+
+void ProviderPluginSessionPrivate::sendToPlugin(int type,
+                                                const QByteArray &payload)
+{
+    if (hostedPlugin != 0)
+        hostedPlugin->d_func()->onMessageReceived(type, payload);
+    else if (channel != 0)
+        channel->sendMessage(PluginChannel::MessageType(type), payload);
+}
+
+void ProviderPluginSessionPrivate::onChannelClosed()
+{
+    if (channel == 0)
+        return;
+
+    closeChannel();
+    if (processFinished)
+        deliverResult();
+}
+
+void ProviderPluginSessionPrivate::closeChannel()
+{
+    if (channel == 0)
+        return;
+
+    channel->disconnect(this);
+    channel->deleteLater();
+    channel = 0;
+}
+
+void ProviderPluginSessionPrivate::setOutputSink(
+                                     ProviderPluginProxy::OutputSink sink,
+                                     const QString &fileName)
+{
+    outputSink = sink;
+    if (sink == ProviderPluginProxy::FileOutput) {
+        outputFile.setFileName(fileName);
+        if (!outputFile.open(QIODevice::WriteOnly | QIODevice::Append |
+                             QIODevice::Unbuffered)) {
+            qWarning() << "Cannot open plugin output file" << fileName;
+            outputSink = ProviderPluginProxy::DiscardOutput;
+        }
+    }
+}
+
+void ProviderPluginSessionPrivate::onReadOutput()
+{
+    Q_Q(ProviderPluginSession);
+
+    /* read in place, rather than in a new QByteArray for each chunk */
+    char chunk[4096];
+    qint64 length;
+    while ((length = process->read(chunk, sizeof(chunk))) > 0) {
+        output.append(chunk, int(length));
+
+        if (outputSink == ProviderPluginProxy::DiscardOutput ||
+            !outputLimiter.allow(int(length)))
+            continue;
+
+        switch (outputSink) {
+        case ProviderPluginProxy::LogOutput:
+            qDebug("%s: %.*s", qPrintable(pluginName), int(length), chunk);
+            break;
+        case ProviderPluginProxy::FileOutput:
+            outputFile.write(chunk, length);
+            break;
+        case ProviderPluginProxy::SignalOutput:
+            emit q->outputReceived(QByteArray(chunk, int(length)));
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+void ProviderPluginSessionPrivate::releaseProcess()
+{
+    pluginName.clear();
+
+    if (process) {
+        process->disconnect(this);
+        process->deleteLater();
+        process = 0;
+    }
+}
+
+void ProviderPluginSessionPrivate::onError(QProcess::ProcessError err)
+{
+    if (err == QProcess::FailedToStart) {
+        failedToStart = true;
+        releaseProcess();
+        closeChannel();
+        finish(ProviderPluginProxy::PluginCrashed);
+    }
+
+    qDebug() << "Error: " << err;
+}
+
+void ProviderPluginSessionPrivate::onFinished(int exitCode,
+                                              QProcess::ExitStatus exitStatus)
+{
+    Q_UNUSED(exitCode);
+
+    trace("process-finished");
+    /* what the plugin wrote last is often what explains a crash */
+    onReadOutput();
+    if (outputLimiter.droppedBytes() > 0)
+        qWarning() << outputLimiter.droppedBytes() <<
+            "bytes of plugin output were not passed on";
+    releaseProcess();
+
+    if (exitStatus == QProcess::CrashExit) {
+        closeChannel();
+        finish(ProviderPluginProxy::PluginCrashed);
+        return;
+    }
+
+    /* If the result is still coming, it's delivered when complete: the
+     * channel reaches its end right after the last byte written by the
+     * plugin. */
+    processFinished = true;
+    if (channel == 0)
+        deliverResult();
+}
+
+void ProviderPluginSessionPrivate::decodeResult()
+{
+    if (resultDecoded)
+        return;
+    resultDecoded = true;
+
+    resultSize = pluginOutput.size();
+    if (!pluginOutput.isEmpty()) {
+        QDataStream stream(pluginOutput);
+        stream.device()->seek(0);
+        stream >> createdAccountId >> exitData;
+    }
+    trace("result-decoded");
+
+    /* the plugin might take a while yet to terminate */
+    if (createdAccountId != Accounts::AccountId(cancelledAccountId))
+        announceAccount(createdAccountId);
+}
+
+void ProviderPluginSessionPrivate::recordMemoryUsage()
+{
+    /* the process is still there, right before exiting */
+    if (process == 0)
+        return;
+
+    PluginScheduler::instance()->recordMemoryUsage(pluginName,
+        PluginScheduler::peakMemory(process->processId()));
+}
+
+void ProviderPluginSessionPrivate::announceAccount(Accounts::AccountId accountId)
+{
+    Q_Q(ProviderPluginSession);
+
+    if (accountAnnounced || accountId == 0)
+        return;
+    accountAnnounced = true;
+    trace("account-ready");
+    emit q->accountReady(accountId);
+}
+
+void ProviderPluginSessionPrivate::deliverResult()
+{
+    decodeResult();
+    releaseSharedResult();
+
+    /* an empty result would pass for a plugin which returned nothing */
+    finish(resultLost ? ProviderPluginProxy::ResultLost :
+           ProviderPluginProxy::NoError);
+}
+
+void ProviderPluginSessionPrivate::finish(ProviderPluginProxy::Error error)
+{
+    Q_Q(ProviderPluginSession);
+
+    /* however the plugin ended, it's because it was asked to */
+    cancelTimer.stop();
+    this->error = cancelling ? ProviderPluginProxy::Cancelled : error;
+    trace("finished");
+    if (!done)
+        metrics.finished(this->error, failedToStart, timeInQueue(),
+                         elapsed.elapsed() - timeInQueue(), resultSize);
+    unschedule();
+
+    doneMutex.lock();
+    done = true;
+    doneCondition.wakeAll();
+    doneMutex.unlock();
+
+    QList<QFutureInterface<ProviderPluginResult> > waiting = futures;
+    futures.clear();
+    foreach (QFutureInterface<ProviderPluginResult> future, waiting)
+        addFuture(future);
+
+    emit q->finished();
+}
+
+void ProviderPluginSessionPrivate::addFuture(
+                              QFutureInterface<ProviderPluginResult> future)
+{
+    if (!done) {
+        futures.append(future);
+        return;
+    }
+
+    future.reportResult(result());
+    future.reportFinished();
+}
+
+ProviderPluginResult ProviderPluginSessionPrivate::result() const
+{
+    ProviderPluginResult result;
+    result.m_providerName = providerName;
+    result.m_serviceType = serviceType;
+    result.m_finished = true;
+    result.m_error = error;
+    result.m_createdAccountId = createdAccountId;
+    result.m_exitData = exitData;
+    result.m_queueTime = timeInQueue();
+    result.m_elapsed = elapsed.elapsed() - result.m_queueTime;
+    return result;
+}
+
+void ProviderPluginSessionPrivate::kill()
+{
+    /* the slot is free as soon as the process is being reaped */
+    unschedule();
+
+    if (hostedPlugin != 0) {
+        /* the plugin might be in the middle of a call */
+        hostedPlugin->d_func()->disconnect(this);
+        hostedPlugin->deleteLater();
+        hostedPlugin = 0;
+        pluginName.clear();
+        return;
+    }
+
+    if (process == 0)
+        return;
+
+    PluginReaper::instance()->reap(process);
+    process = 0;
+
+    releaseProcess();
+    closeChannel();
+}
+
+void ProviderPluginSessionPrivate::cancel(int timeout)
+{
+    /* nothing to wait for, if the plugin hasn't been launched yet */
+    if (queued) {
+        unschedule();
+        finish(ProviderPluginProxy::Cancelled);
+        return;
+    }
+
+    if (cancelling || (process == 0 && hostedPlugin == 0))
+        return;
+
+    cancelling = true;
+    sendToPlugin(PluginChannel::Cancel, QByteArray());
+    cancelTimer.start(timeout);
+}
+
+void ProviderPluginSessionPrivate::onCancelTimeout()
+{
+    if (hostedPlugin != 0) {
+        /* nothing else can be done with a plugin in this process */
+        kill();
+        finish(ProviderPluginProxy::Cancelled);
+        return;
+    }
+
+    if (process == 0)
+        return;
+
+    /* onFinished() follows, whichever way the process ends */
+    if (!terminated) {
+        qWarning() << "Plugin not cancelling, terminating it";
+        process->terminate();
+        terminated = true;
+        cancelTimer.start();
+    } else {
+        qWarning() << "Plugin not terminating, killing it";
+        process->kill();
+    }
+}
+
+ProviderPluginSession::ProviderPluginSession(QObject *parent):
+    QObject(parent),
+    d_ptr(new ProviderPluginSessionPrivate(this))
+{
+}
+
+ProviderPluginSession::~ProviderPluginSession()
+{
+    Q_D(ProviderPluginSession);
+    delete d;
+}
+
+bool ProviderPluginSession::isRunning() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->process != 0 || d->hostedPlugin != 0 || d->queued;
+}
+
+SetupType ProviderPluginSession::setupType() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->setupType;
+}
+
+QString ProviderPluginSession::pluginName() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->pluginName;
+}
+
+QString ProviderPluginSession::providerName() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->providerName;
+}
+
+ProviderPluginProxy::Error ProviderPluginSession::error() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->error;
+}
+
+bool ProviderPluginSession::accountCreated() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->createdAccountId != 0;
+}
+
+Accounts::AccountId ProviderPluginSession::createdAccountId() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->createdAccountId;
+}
+
+QVariant ProviderPluginSession::exitData() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->exitData;
+}
+
+void ProviderPluginSession::requestCancel()
+{
+    Q_D(ProviderPluginSession);
+    if (d->queued) {
+        d->cancel(0);
+        return;
+    }
+    d->sendToPlugin(PluginChannel::Cancel, QByteArray());
+}
+
+void ProviderPluginSession::cancel(int msecs)
+{
+    Q_D(ProviderPluginSession);
+    d->cancel(msecs);
+}
+
+void ProviderPluginSession::requestFocus()
+{
+    Q_D(ProviderPluginSession);
+    d->sendToPlugin(PluginChannel::Focus, QByteArray());
+}
+
+void ProviderPluginSession::updateParameters(const QVariantMap &parameters)
+{
+    Q_D(ProviderPluginSession);
+
+    QByteArray payload;
+    QDataStream stream(&payload, QIODevice::WriteOnly);
+    stream << QVariant(parameters);
+    d->sendToPlugin(PluginChannel::Parameters, payload);
+}
+
+qint64 ProviderPluginSession::queueTime() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->timeInQueue();
+}
+
+QByteArray ProviderPluginSession::lastOutput(int maxBytes) const
+{
+    Q_D(const ProviderPluginSession);
+    return d->output.last(maxBytes);
+}
+
+bool ProviderPluginSession::waitForFinished(int msecs)
+{
+    Q_D(ProviderPluginSession);
+
+    if (QThread::currentThread() != thread()) {
+        QMutexLocker locker(&d->doneMutex);
+        QElapsedTimer timer;
+        timer.start();
+        while (!d->done) {
+            ulong remaining = msecs < 0 ? ULONG_MAX :
+                ulong(qMax(qint64(msecs) - timer.elapsed(), qint64(0)));
+            if (remaining == 0 ||
+                !d->doneCondition.wait(&d->doneMutex, remaining))
+                break;
+        }
+        return d->done;
+    }
+
+    /* The session's sockets and timers are served by the event loop of this
+     * thread, which would have to be re-entered: other sessions and
+     * objects would run meanwhile, and could even delete this one. */
+    if (!d->done && msecs != 0)
+        qWarning("ProviderPluginSession::waitForFinished: cannot wait in the "
+                 "thread of the session; use the finished() signal, or "
+                 "ProviderPluginProxy::createAccountAsync()");
+    return d->done;
+}
+
+QList<ProviderPluginTraceEvent> ProviderPluginSession::traceEvents() const
+{
+    Q_D(const ProviderPluginSession);
+    return d->traceEvents;
+}
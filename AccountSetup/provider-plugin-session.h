@@ -0,0 +1,256 @@
+/*
+ * This file is part of accounts-ui
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+/*!
+ * @copyright Copyright (C) 2011 Nokia Corporation.
+ * @license LGPL
+ */
+
+#ifndef ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_H
+#define ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_H
+
+// libAccountSetup
+#include <AccountSetup/common.h>
+#include <AccountSetup/provider-plugin-proxy.h>
+#include <AccountSetup/types.h>
+
+// Qt
+#include <QList>
+#include <QObject>
+#include <QVariant>
+
+namespace AccountSetup {
+
+class ProviderPluginSessionPrivate;
+
+/*!
+ * @struct ProviderPluginTraceEvent
+ * @headerfile AccountSetup/provider-plugin-session.h \
+ * AccountSetup/ProviderPluginSession
+ * @brief A point in the execution of a plugin, recorded when tracing is
+ * enabled.
+ *
+ * @details The timestamps of the caller and of the plugin process are taken
+ * from the same monotonic clock, so the events of a session can be merged
+ * into a single timeline.
+ * @sa ProviderPluginProxy::setTracingEnabled()
+ */
+struct ACCOUNTSETUP_EXPORT ProviderPluginTraceEvent
+{
+    /*! The name of the execution phase. */
+    QString name;
+    /*! Whether the event was recorded by the plugin, not by the caller. */
+    bool fromPlugin;
+    /*! The process where the event was recorded. */
+    qint64 pid;
+    /*! Identifies the session among those started by the same proxy. */
+    int sessionId;
+    /*! The time of the event, in microseconds from an unspecified point. */
+    qint64 timestamp;
+};
+
+/*!
+ * @class ProviderPluginSession
+ * @headerfile AccountSetup/provider-plugin-session.h \
+ * AccountSetup/ProviderPluginSession
+ * @brief A single execution of an account plugin.
+ *
+ * @details ProviderPluginSession objects are returned by
+ * ProviderPluginProxy::createAccount() and ProviderPluginProxy::editAccount(),
+ * and hold the state and the results of one plugin execution. Any number of
+ * sessions can be running at the same time.
+ *
+ * Like a QNetworkReply, a session belongs to the caller, who must delete it
+ * once done with it, with deleteLater() from a slot connected to the
+ * finished() signal. The proxy never deletes the sessions it returns; they
+ * remain children of the ProviderPluginProxy, and are deleted with it if
+ * the caller doesn't delete them first.
+ */
+class ACCOUNTSETUP_EXPORT ProviderPluginSession: public QObject
+{
+    Q_OBJECT
+
+public:
+    virtual ~ProviderPluginSession();
+
+    /*!
+     * @return Whether the plugin process is still running.
+     */
+    bool isRunning() const;
+
+    /*!
+     * @return The operation being performed by the plugin.
+     */
+    SetupType setupType() const;
+
+    /*!
+     * @return The name of the plugin executable, or empty string if no
+     * plugin is running.
+     */
+    QString pluginName() const;
+
+    /*!
+     * @return The name of the provider of the plugin.
+     */
+    QString providerName() const;
+
+    /*!
+     * Gets the error code of the plugin execution.
+     * @note This method should be called only after the finished() signal has
+     * been emitted.
+     */
+    ProviderPluginProxy::Error error() const;
+
+    /*!
+     * @return Whether an account has been successfully created.
+     */
+    bool accountCreated() const;
+
+    /*!
+     * @return The account ID of the created account.
+     */
+    Accounts::AccountId createdAccountId() const;
+
+    /*!
+     * @return the extra data that the plugin returned when terminating.
+     */
+    QVariant exitData() const;
+
+    /*!
+     * @return How long the plugin has waited, or is still waiting, for
+     * other plugins to finish before being launched, in milliseconds.
+     * @sa ProviderPluginProxy::setMaxRunningPlugins()
+     */
+    qint64 queueTime() const;
+
+    /*!
+     * Asks the plugin to terminate as soon as possible, as if the user had
+     * cancelled the operation. The finished() signal will be emitted when
+     * the plugin has terminated.
+     */
+    void requestCancel();
+
+    /*!
+     * Cancels the plugin execution without blocking. The plugin is first
+     * asked to terminate, as with requestCancel(); if it's still running
+     * after @a msecs, it's sent SIGTERM, and after as long again, SIGKILL.
+     * In any case, the finished() signal is emitted when the plugin has
+     * terminated, with the ProviderPluginProxy::Cancelled error.
+     * @param msecs How long the plugin gets for each step.
+     */
+    void cancel(int msecs = 5000);
+
+    /*!
+     * Asks the plugin to bring its UI to the foreground.
+     */
+    void requestFocus();
+
+    /*!
+     * Sends new parameters to the running plugin; how they are used depends
+     * on the plugin.
+     * @param parameters The parameters.
+     */
+    void updateParameters(const QVariantMap &parameters);
+
+    /*!
+     * Gets what the plugin process wrote on its standard output and error,
+     * which is kept even if the output is discarded. Only the last bytes
+     * are kept.
+     * @sa ProviderPluginProxy::setOutputBufferSize()
+     * @param maxBytes How many bytes to return at most, or -1 for all
+     * those kept.
+     *
+     * @return The last bytes written by the plugin.
+     */
+    QByteArray lastOutput(int maxBytes = -1) const;
+
+    /*!
+     * @return The events recorded so far, if tracing was enabled when the
+     * session was started.
+     * @sa ProviderPluginProxy::setTracingEnabled()
+     */
+    QList<ProviderPluginTraceEvent> traceEvents() const;
+
+    /*!
+     * Blocks until the plugin execution has been completed, or until
+     * @a msecs have passed. This is meant for other threads, which have no
+     * event loop to return to: the caller just sleeps.
+     * @note In the thread of the session, whose event loop serves the
+     * plugin, this never blocks: it tells whether the execution has been
+     * completed, and warns if it hasn't and @a msecs is not 0. Wait for the
+     * finished() signal there, or use
+     * ProviderPluginProxy::createAccountAsync().
+     * @note From another thread, the session must not be deleted while
+     * waiting; the futures returned by
+     * ProviderPluginProxy::createAccountAsync() don't have this problem.
+     * @param msecs How long to wait at most, or -1 to wait without limit.
+     *
+     * @return Whether the plugin execution has been completed.
+     */
+    bool waitForFinished(int msecs = 30000);
+
+Q_SIGNALS:
+    /*!
+     * Emitted when the plugin execution has been completed.
+     */
+    void finished();
+
+    /*!
+     * Emitted when the plugin reports progress.
+     * @param progress The plugin specific progress information.
+     */
+    void progressReported(const QVariant &progress);
+
+    /*!
+     * Emitted when the plugin sends some results before terminating.
+     * @param data The plugin specific data.
+     */
+    void partialResultReceived(const QVariant &data);
+
+    /*!
+     * Emitted as soon as the account has been stored by the plugin, which
+     * might still be running for a while: either when the plugin reports
+     * it with ProviderPluginProcess::reportAccountReady(), or when its
+     * result arrives. Emitted at most once, and not at all if no account
+     * was stored.
+     * @param accountId The ID of the created or edited account.
+     */
+    void accountReady(Accounts::AccountId accountId);
+
+    /*!
+     * Emitted when the plugin process writes on its standard output or
+     * error, if the output sink is ProviderPluginProxy::SignalOutput.
+     * @param output The bytes written.
+     */
+    void outputReceived(const QByteArray &output);
+
+private:
+    friend class ProviderPluginProxy;
+    friend class ProviderPluginProxyPrivate;
+    ProviderPluginSession(QObject *parent);
+
+    ProviderPluginSessionPrivate *d_ptr;
+    Q_DECLARE_PRIVATE(ProviderPluginSession)
+};
+
+} // namespace
+
+#endif // ACCOUNTSETUP_PROVIDER_PLUGIN_SESSION_H
@@ -3,7 +3,7 @@ include(common-vars.pri)
 TEMPLATE = subdirs
 
 CONFIG += ordered
-SUBDIRS += AccountSetup tests
+SUBDIRS += AccountSetup tools tests
 
 include(doc/doc.pri)
 
@@ -0,0 +1,562 @@
+/*
+ * This file is part of libAccountSetup
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include "benchmark.h"
+
+#include <AccountSetup/ProviderPluginBatch>
+#include <AccountSetup/ProviderPluginProxy>
+#include <AccountSetup/ProviderPluginSession>
+#include "AccountSetup/plugin-index.h"
+#include "AccountSetup/plugin-metrics.h"
+#include "AccountSetup/plugin-resolver.h"
+#include <Accounts/Manager>
+#include <QFile>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QtTest/QtTest>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+class ProviderPluginProxyTest: public ProviderPluginProxy
+{
+public:
+    void setExitDataSize(int size)
+    {
+        QStringList parameters;
+        parameters << "--exit-data-size" << QString::number(size);
+        setAdditionalParameters(parameters);
+    }
+
+    void setEchoMode()
+    {
+        setAdditionalParameters(QStringList() << "--echo");
+    }
+
+    void setParameters(const QStringList &parameters)
+    {
+        setAdditionalParameters(parameters);
+    }
+};
+
+static const int launchCount = 10;
+/* time given to a standby plugin to complete its initialization */
+static const int standbyDelay = 2000;
+/* providers in the plugin lookup benchmarks */
+static const int providerCount = 500;
+/* messages exchanged with a running plugin in each benchmark iteration */
+static const int roundTripCount = 1000;
+static const int metricsRecordCount = 100000;
+/* plugins run in each throughput measurement */
+static const int throughputCount = 32;
+
+LatencyProbe::LatencyProbe():
+    m_maxLatency(0)
+{
+    m_timer.setInterval(1);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimeout()));
+}
+
+void LatencyProbe::start()
+{
+    m_maxLatency = 0;
+    m_elapsed.start();
+    m_timer.start();
+}
+
+void LatencyProbe::stop()
+{
+    m_timer.stop();
+}
+
+void LatencyProbe::onTimeout()
+{
+    m_maxLatency = qMax(m_maxLatency, m_elapsed.restart());
+}
+
+void Benchmark::initTestCase()
+{
+    setenv("ACCOUNTS", "/tmp/", TRUE);
+    setenv("AG_PROVIDERS", PROVIDERS_DIR, TRUE);
+}
+
+qreal Benchmark::runPlugin(ProviderPluginProxy *proxy, Provider provider)
+{
+    QEventLoop loop;
+    QObject::connect(proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+
+    QElapsedTimer timer;
+    timer.start();
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    loop.exec();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    if (proxy->isPluginRunning() ||
+        proxy->error() != ProviderPluginProxy::NoError) {
+        qWarning() << "Plugin execution failed";
+    }
+    delete session;
+    return elapsed / 1000000.0;
+}
+
+void Benchmark::coldLaunch()
+{
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxy proxy;
+    qreal total = 0;
+    for (int i = 0; i < launchCount; i++)
+        total += runPlugin(&proxy, provider);
+
+    QTest::setBenchmarkResult(total / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+void Benchmark::standbyLaunch()
+{
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxy proxy;
+    qreal total = 0;
+    for (int i = 0; i < launchCount; i++) {
+        QVERIFY(proxy.startStandbyPlugin(provider));
+        QTest::qWait(standbyDelay);
+        total += runPlugin(&proxy, provider);
+    }
+
+    QTest::setBenchmarkResult(total / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+void Benchmark::firstFrame_data()
+{
+    QTest::addColumn<bool>("accountFirst");
+
+    QTest::newRow("account first") << true;
+    QTest::newRow("UI first") << false;
+}
+
+/*
+ * The time from the call to createAccount() to the plugin reporting that
+ * its UI is shown, with the account loaded before or after it.
+ */
+void Benchmark::firstFrame()
+{
+    QFETCH(bool, accountFirst);
+
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest proxy;
+    if (accountFirst)
+        proxy.setParameters(QStringList() << "--account-first");
+    proxy.setTracingEnabled(true);
+
+    qint64 total = 0;
+    for (int i = 0; i < launchCount; i++) {
+        QEventLoop loop;
+        QObject::connect(&proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+
+        ProviderPluginSession *session =
+            proxy.createAccount(provider, QString());
+        loop.exec();
+        QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+        qint64 created = -1, uiReady = -1;
+        foreach (const ProviderPluginTraceEvent &event,
+                 session->traceEvents()) {
+            if (event.name == "session-created")
+                created = event.timestamp;
+            else if (event.name == "ui-ready")
+                uiReady = event.timestamp;
+        }
+        QVERIFY(created >= 0 && uiReady >= created);
+        total += uiReady - created;
+        delete session;
+    }
+
+    QTest::setBenchmarkResult(total / 1000.0 / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+/*
+ * Milliseconds per plugin, when running many of them with at most the given
+ * number at the same time.
+ */
+void Benchmark::launchThroughput_data()
+{
+    QTest::addColumn<int>("parallelism");
+
+    QTest::newRow("sequential") << 1;
+    QTest::newRow("4 parallel") << 4;
+    QTest::newRow("16 parallel") << 16;
+}
+
+void Benchmark::launchThroughput()
+{
+    QFETCH(int, parallelism);
+
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxy proxy;
+    ProviderPluginBatch *batch = proxy.createBatch();
+    batch->setParallelism(parallelism);
+    batch->setStandbyEnabled(false);
+    for (int i = 0; i < throughputCount; i++)
+        batch->addJob(provider);
+
+    QEventLoop loop;
+    QObject::connect(batch, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(60*1000, &loop, SLOT(quit()));
+    batch->start();
+    loop.exec();
+    QVERIFY(!batch->isRunning());
+
+    foreach (const ProviderPluginResult &result, batch->results())
+        QCOMPARE(result.error(), ProviderPluginProxy::NoError);
+
+    QTest::setBenchmarkResult(qreal(batch->elapsed()) / throughputCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+void Benchmark::spawnLatency_data()
+{
+    QTest::addColumn<int>("launcher");
+    QTest::addColumn<int>("residentMegabytes");
+
+    QList<int> sizes;
+    sizes << 0 << 256 << 1024;
+    foreach (int size, sizes) {
+        QTest::newRow(qPrintable(QString("fork, %1 MB").arg(size))) <<
+            int(ProviderPluginProxy::ForkLauncher) << size;
+        QTest::newRow(qPrintable(QString("spawn, %1 MB").arg(size))) <<
+            int(ProviderPluginProxy::SpawnLauncher) << size;
+    }
+}
+
+/* fork() copies the page tables of the caller, posix_spawn() doesn't */
+void Benchmark::spawnLatency()
+{
+    QFETCH(int, launcher);
+    QFETCH(int, residentMegabytes);
+
+    /* filled, so that it's all resident */
+    QByteArray ballast(residentMegabytes * 1024 * 1024, 'x');
+
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxy proxy;
+    proxy.setLauncher(ProviderPluginProxy::Launcher(launcher));
+    qreal total = 0;
+    for (int i = 0; i < launchCount; i++)
+        total += runPlugin(&proxy, provider);
+
+    QTest::setBenchmarkResult(total / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+/*
+ * One third of the providers have their own plugin, one third name a
+ * missing plugin, and the rest fall back to the generic plugin.
+ */
+void Benchmark::createProviders(QDir &providerDir, QDir &pluginDir)
+{
+    QDir tmp(QDir::temp());
+    tmp.mkdir("accountsetup-bench-providers");
+    tmp.mkdir("accountsetup-bench-plugins");
+    providerDir = QDir(tmp.filePath("accountsetup-bench-providers"));
+    pluginDir = QDir(tmp.filePath("accountsetup-bench-plugins"));
+
+    QFile generic(pluginDir.filePath("genericplugin"));
+    generic.open(QIODevice::WriteOnly);
+
+    for (int i = 0; i < providerCount; i++) {
+        QString name = QString("bench%1").arg(i);
+        QFile file(providerDir.filePath(name + ".provider"));
+        file.open(QIODevice::WriteOnly);
+        file.write("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                   "<provider version=\"1.0\" id=\"" + name.toLatin1() +
+                   "\">\n  <name>Benchmark provider</name>\n");
+        if (i % 3 == 0) {
+            file.write("  <plugin>" + name.toLatin1() + "</plugin>\n");
+            QFile plugin(pluginDir.filePath(name + "plugin"));
+            plugin.open(QIODevice::WriteOnly);
+        } else if (i % 3 == 1) {
+            file.write("  <plugin>missing" + name.toLatin1() +
+                       "</plugin>\n");
+        }
+        file.write("</provider>\n");
+    }
+}
+
+/*
+ * Empty plugin directories, searched before the one where the plugins are.
+ */
+QStringList Benchmark::pluginDirectories(const QDir &pluginDir, int count)
+{
+    QStringList pluginDirs;
+    QDir tmp(QDir::temp());
+    for (int i = 1; i < count; i++) {
+        QString name = QString("accountsetup-bench-empty%1").arg(i);
+        tmp.mkdir(name);
+        pluginDirs << tmp.filePath(name);
+    }
+    pluginDirs << pluginDir.path();
+    return pluginDirs;
+}
+
+void Benchmark::scanLookup_data()
+{
+    QTest::addColumn<int>("directories");
+
+    QTest::newRow("1 directory") << 1;
+    QTest::newRow("10 directories") << 10;
+    QTest::newRow("50 directories") << 50;
+}
+
+void Benchmark::scanLookup()
+{
+    QFETCH(int, directories);
+
+    QDir providerDir, pluginDir;
+    createProviders(providerDir, pluginDir);
+    setenv("AG_PROVIDERS", QFile::encodeName(providerDir.path()).constData(),
+           TRUE);
+
+    Manager manager;
+    ProviderList providers = manager.providerList();
+    QVERIFY(providers.count() >= providerCount);
+    QStringList pluginDirs = pluginDirectories(pluginDir, directories);
+
+    QBENCHMARK {
+        foreach (Provider provider, providers)
+            PluginResolver::scan(provider, pluginDirs);
+    }
+
+    setenv("AG_PROVIDERS", PROVIDERS_DIR, TRUE);
+}
+
+void Benchmark::indexLookup_data()
+{
+    scanLookup_data();
+}
+
+void Benchmark::indexLookup()
+{
+    QFETCH(int, directories);
+
+    QDir providerDir, pluginDir;
+    createProviders(providerDir, pluginDir);
+    setenv("AG_PROVIDERS", QFile::encodeName(providerDir.path()).constData(),
+           TRUE);
+
+    Manager manager;
+    QStringList providerNames;
+    foreach (Provider provider, manager.providerList())
+        providerNames << provider.name();
+    QVERIFY(providerNames.count() >= providerCount);
+    QStringList pluginDirs = pluginDirectories(pluginDir, directories);
+
+    QString indexFile = QDir::temp().filePath("accountsetup-bench.index");
+    QVERIFY(PluginIndex::build(indexFile, &manager, pluginDirs));
+
+    PluginIndex index;
+    QVERIFY(index.open(indexFile));
+    QVERIFY(!index.isStale());
+
+    PluginLocation location;
+    QBENCHMARK {
+        foreach (const QString &name, providerNames)
+            index.lookup(name, location);
+    }
+
+    setenv("AG_PROVIDERS", PROVIDERS_DIR, TRUE);
+}
+
+void Benchmark::resultLatency_data()
+{
+    QTest::addColumn<int>("size");
+
+    QTest::newRow("empty") << 0;
+    QTest::newRow("64KB") << 64 * 1024;
+    QTest::newRow("1MB") << 1024 * 1024;
+    QTest::newRow("16MB") << 16 * 1024 * 1024;
+}
+
+/*
+ * The worst event loop latency while a plugin returns exit data of the given
+ * size; it should not grow with the size.
+ */
+void Benchmark::resultLatency()
+{
+    QFETCH(int, size);
+
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest proxy;
+    proxy.setExitDataSize(size);
+
+    LatencyProbe probe;
+    qint64 total = 0;
+    for (int i = 0; i < launchCount; i++) {
+        QEventLoop loop;
+        QObject::connect(&proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+
+        probe.start();
+        ProviderPluginSession *session =
+            proxy.createAccount(provider, QString());
+        loop.exec();
+        probe.stop();
+
+        QCOMPARE(proxy.error(), ProviderPluginProxy::NoError);
+        QCOMPARE(proxy.exitData().toByteArray().size(), size);
+        total += probe.maxLatency();
+        delete session;
+    }
+
+    QTest::setBenchmarkResult(qreal(total) / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+void Benchmark::resultDecode_data()
+{
+    resultLatency_data();
+}
+
+/*
+ * The time from the arrival of the result to its delivery, as traced by the
+ * session: receiving the shared buffer, if any, and decoding the exit data.
+ */
+void Benchmark::resultDecode()
+{
+    QFETCH(int, size);
+
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest proxy;
+    proxy.setExitDataSize(size);
+    proxy.setTracingEnabled(true);
+
+    qint64 total = 0;
+    for (int i = 0; i < launchCount; i++) {
+        QEventLoop loop;
+        QObject::connect(&proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+        QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+
+        ProviderPluginSession *session =
+            proxy.createAccount(provider, QString());
+        loop.exec();
+        QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+        QCOMPARE(session->exitData().toByteArray().size(), size);
+
+        qint64 received = -1, decoded = -1;
+        foreach (const ProviderPluginTraceEvent &event,
+                 session->traceEvents()) {
+            if (event.fromPlugin)
+                continue;
+            if (event.name == "result-received")
+                received = event.timestamp;
+            else if (event.name == "result-decoded")
+                decoded = event.timestamp;
+        }
+        QVERIFY(received >= 0 && decoded >= received);
+        total += decoded - received;
+        delete session;
+    }
+
+    QTest::setBenchmarkResult(total / 1000.0 / launchCount,
+                              QTest::WalltimeMilliseconds);
+}
+
+/*
+ * Small messages sent to a running plugin, which sends each of them back
+ * before the next one is sent.
+ */
+void Benchmark::messageRoundTrip()
+{
+    Manager manager;
+    Provider provider = manager.provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest proxy;
+    proxy.setEchoMode();
+    ProviderPluginSession *session = proxy.createAccount(provider, QString());
+
+    QEventLoop loop;
+    QObject::connect(session, SIGNAL(progressReported(const QVariant &)),
+                     &loop, SLOT(quit()));
+    QObject::connect(session, SIGNAL(partialResultReceived(const QVariant &)),
+                     &loop, SLOT(quit()));
+    QObject::connect(session, SIGNAL(finished()), &loop, SLOT(quit()));
+
+    /* wait for the plugin to be ready */
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+    loop.exec();
+    QVERIFY(session->isRunning());
+
+    QVariantMap parameters;
+    QBENCHMARK {
+        for (int i = 0; i < roundTripCount; i++) {
+            parameters.insert("sequence", i);
+            session->updateParameters(parameters);
+            loop.exec();
+        }
+    }
+    QVERIFY(session->isRunning());
+
+    session->requestCancel();
+    loop.exec();
+}
+
+/* what recording a whole plugin execution costs */
+void Benchmark::metricsRecord()
+{
+    PluginMetrics metrics;
+    metrics.setProvider("NutProvider");
+    metrics.setPlugin("testplugin");
+
+    QBENCHMARK {
+        for (int i = 0; i < metricsRecordCount; i++) {
+            metrics.launched();
+            metrics.finished(ProviderPluginProxy::NoError, false, 0, i, i);
+        }
+    }
+}
+
+QTEST_MAIN(Benchmark)
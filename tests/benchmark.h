@@ -0,0 +1,91 @@
+/*
+ * This file is part of libAccountSetup
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Accounts/Provider>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+
+namespace AccountSetup {
+class ProviderPluginProxy;
+}
+
+/* Measures the longest time the event loop was unable to run a timer */
+class LatencyProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    LatencyProbe();
+
+    void start();
+    void stop();
+    qint64 maxLatency() const { return m_maxLatency; }
+
+private slots:
+    void onTimeout();
+
+private:
+    QTimer m_timer;
+    QElapsedTimer m_elapsed;
+    qint64 m_maxLatency;
+};
+
+class Benchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+
+    void coldLaunch();
+    void standbyLaunch();
+    void firstFrame_data();
+    void firstFrame();
+    void launchThroughput_data();
+    void launchThroughput();
+    void spawnLatency_data();
+    void spawnLatency();
+    void scanLookup_data();
+    void scanLookup();
+    void indexLookup_data();
+    void indexLookup();
+    void resultLatency_data();
+    void resultLatency();
+    void resultDecode_data();
+    void resultDecode();
+    void messageRoundTrip();
+    void metricsRecord();
+
+private:
+    void createProviders(QDir &providerDir, QDir &pluginDir);
+    QStringList pluginDirectories(const QDir &pluginDir, int count);
+
+    qreal runPlugin(AccountSetup::ProviderPluginProxy *proxy,
+                    Accounts::Provider provider);
+};
+
+#endif
@@ -0,0 +1,44 @@
+include(../common-project-config.pri)
+include($${TOP_SRC_DIR}/common-vars.pri)
+
+QMAKE_EXTRA_TARGETS += benchmark benchmark-report
+benchmark.depends = libaccountsetup-benchmark
+benchmark.commands = ./libaccountsetup-benchmark
+
+# the same results in QTestLib's XML format, to compare between releases
+benchmark-report.depends = libaccountsetup-benchmark
+benchmark-report.commands = \
+    ./libaccountsetup-benchmark -xml -o libaccountsetup-benchmark.xml
+QMAKE_CLEAN += libaccountsetup-benchmark.xml
+
+TARGET = libaccountsetup-benchmark
+
+CONFIG += \
+    qtestlib \
+    qt
+# the library keeps these private, so they're built in again
+SOURCES += \
+    benchmark.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-index.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-metrics.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-resolver.cpp
+HEADERS += \
+    benchmark.h \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-index.h \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-metrics.h \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-resolver.h
+
+QT += core xml
+
+LIBS += -lAccountSetup
+DEPENDPATH += $${INCLUDEPATH}
+PKGCONFIG += \
+    accounts-qt
+include($${TOP_SRC_DIR}/AccountSetup/libaccounts-glib.pri)
+
+include($${TOP_SRC_DIR}/common-installs-config.pri)
+
+DATA_PATH = $${INSTALL_PREFIX}/share/libaccountsetup-tests/
+
+DEFINES += \
+    PROVIDERS_DIR=\\\"$$DATA_PATH\\\"
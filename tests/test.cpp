@@ -22,15 +22,27 @@
 
 #include "test.h"
 
+#include <AccountSetup/ProviderPluginBatch>
 #include <AccountSetup/ProviderPluginProxy>
+#include <AccountSetup/ProviderPluginSession>
+#include "AccountSetup/plugin-prefetch.h"
 #include <Accounts/Account>
 #include <Accounts/Manager>
+#include <QDir>
 #include <QEventLoop>
+#include <QFutureWatcher>
 #include <QSettings>
 #include <QSignalSpy>
+#include <QThread>
+#include <QThreadPool>
 #include <QTimer>
 #include <QtTest/QtTest>
 
+#include <malloc.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace Accounts;
 using namespace AccountSetup;
 
@@ -48,8 +60,153 @@ public:
         parameters << "--config-file" << dumpFile;
         setAdditionalParameters(parameters);
     }
+
+    void setEchoMode()
+    {
+        setAdditionalParameters(QStringList() << "--echo");
+    }
+
+    void setExitDataSize(int size)
+    {
+        QStringList parameters;
+        parameters << "--exit-data-size" << QString::number(size);
+        setAdditionalParameters(parameters);
+    }
+
+    void setParameters(const QStringList &parameters)
+    {
+        setAdditionalParameters(parameters);
+    }
+
+    bool kill()
+    {
+        return killRunningPlugin();
+    }
 };
 
+/* Starts plugins from outside of the thread of the proxy, and collects
+ * their results without an event loop */
+class AsyncCaller: public QThread
+{
+public:
+    AsyncCaller(ProviderPluginProxy *proxy, Provider provider, int count,
+                ProviderPluginSession *session):
+        m_proxy(proxy),
+        m_provider(provider),
+        m_count(count),
+        m_session(session),
+        m_sessionFinished(false)
+    {
+    }
+
+    QList<ProviderPluginResult> results() const { return m_results; }
+    bool sessionFinished() const { return m_sessionFinished; }
+
+protected:
+    void run()
+    {
+        QList<QFuture<ProviderPluginResult> > futures;
+        for (int i = 0; i < m_count; i++)
+            futures.append(m_proxy->createAccountAsync(m_provider,
+                                                       QString::number(i)));
+        foreach (QFuture<ProviderPluginResult> future, futures) {
+            future.waitForFinished();
+            m_results.append(future.result());
+        }
+        m_sessionFinished = m_session->waitForFinished(10000);
+    }
+
+private:
+    ProviderPluginProxy *m_proxy;
+    Provider m_provider;
+    int m_count;
+    ProviderPluginSession *m_session;
+    bool m_sessionFinished;
+    QList<ProviderPluginResult> m_results;
+};
+
+static bool waitForSignal(QSignalSpy &spy, int count, int timeout = 10000)
+{
+    QTime timer;
+    timer.start();
+    while (spy.count() < count && timer.elapsed() < timeout)
+        QTest::qWait(10);
+    return spy.count() >= count;
+}
+
+/* sessions can't be waited for in their own thread: poll them instead */
+static bool waitForSession(ProviderPluginSession *session,
+                           int timeout = 10000)
+{
+    QTime timer;
+    timer.start();
+    while (!session->waitForFinished(0) && timer.elapsed() < timeout)
+        QTest::qWait(10);
+    return session->waitForFinished(0);
+}
+
+static int openFileCount()
+{
+    return QDir("/proc/self/fd").entryList(QDir::AllEntries | QDir::System |
+                                           QDir::NoDotAndDotDot).count();
+}
+
+static qint64 heapInUse()
+{
+    struct mallinfo info = mallinfo();
+    return qint64(info.uordblks) + qint64(info.hblkhd);
+}
+
+/* the children of this process; with zombiesOnly, those not reaped yet */
+static int childProcesses(bool zombiesOnly)
+{
+    int children = 0;
+    QDir proc("/proc");
+    foreach (const QString &entry, proc.entryList(QDir::Dirs)) {
+        bool isPid;
+        entry.toInt(&isPid);
+        if (!isPid)
+            continue;
+
+        /* "pid (name) state ppid ..."; the name can contain anything */
+        QFile file(proc.filePath(entry + "/stat"));
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QByteArray stat = file.readAll();
+        QList<QByteArray> fields =
+            stat.mid(stat.lastIndexOf(')') + 2).split(' ');
+        if (fields.count() > 1 && fields[1].toInt() == getpid() &&
+            (!zombiesOnly || fields[0] == "Z"))
+            children++;
+    }
+    return children;
+}
+
+static int zombieChildren()
+{
+    return childProcesses(true);
+}
+
+static int tmpSocketCount()
+{
+    int sockets = 0;
+    QDir tmp(QDir::temp());
+    foreach (const QString &entry, tmp.entryList(QDir::System)) {
+        struct stat info;
+        if (::lstat(QFile::encodeName(tmp.filePath(entry)).constData(),
+                    &info) == 0 && S_ISSOCK(info.st_mode))
+            sockets++;
+    }
+    return sockets;
+}
+
+/* how much a metrics counter grew between two snapshots */
+static int countDelta(const QVariantMap &before, const QVariantMap &after,
+                      const QString &name)
+{
+    return after.value(name).toInt() - before.value(name).toInt();
+}
+
 void clearDb()
 {
     QDir dbroot(QString(getenv("ACCOUNTS")));
@@ -97,6 +254,13 @@ void Test::onFinished()
     finishedEmitted = true;
 }
 
+void Test::onSessionFinished(ProviderPluginSession *session)
+{
+    QVERIFY(sessionIndexes.contains(session));
+    QVERIFY(!session->isRunning());
+    sessionErrors.insert(sessionIndexes.value(session), session->error());
+}
+
 void Test::pluginStatusTest()
 {
     Manager *manager = new Manager();
@@ -132,10 +296,1176 @@ void Test::pluginStatusTest()
     QCOMPARE(status.value("SetupType").toInt(), (int)CreateNew);
     QCOMPARE(status.value("ServiceType").toString(), serviceType);
 
+    /* the task is on the command line too, but only once in arguments() */
+    QStringList commandLine = status.value("CommandLine").toStringList();
+    QVERIFY(commandLine.contains("--create"));
+    QVERIFY(commandLine.contains("--config-file"));
+    QCOMPARE(status.value("Arguments").toStringList().count("--create"), 1);
+
     QCOMPARE(proxy->error(), ProviderPluginProxy::NoError);
 
     delete manager;
 }
 
-QTEST_MAIN(Test)
+void Test::standbyPluginTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QObject::connect(proxy, SIGNAL(finished()),
+                     this, SLOT(onFinished()));
+
+    QEventLoop loop;
+    QObject::connect(proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+    finishedEmitted = false;
+
+    QVERIFY(proxy->startStandbyPlugin(provider));
+    /* starting it twice is harmless */
+    QVERIFY(proxy->startStandbyPlugin(provider));
+    QVERIFY(!proxy->isPluginRunning());
+
+    const QString dumpFile("/tmp/testplugin-standby.dump");
+    QFile::remove(dumpFile);
+    proxy->setDumpFile(dumpFile);
+
+    const QString serviceType("AnyServiceType");
+    proxy->createAccount(provider, serviceType);
+    QVERIFY(!finishedEmitted);
+    QVERIFY(proxy->isPluginRunning());
+
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+    loop.exec();
+    QVERIFY(finishedEmitted);
+    QVERIFY(!proxy->isPluginRunning());
+
+    /* the launch parameters must have reached the standby plugin */
+    QSettings status(dumpFile);
+    QCOMPARE(status.value("ping").toString(), QString("pong"));
+    QCOMPARE(status.value("SetupType").toInt(), (int)CreateNew);
+    QCOMPARE(status.value("ServiceType").toString(), serviceType);
+
+    QCOMPARE(proxy->error(), ProviderPluginProxy::NoError);
+
+    /* an unused standby plugin must be terminated cleanly */
+    QVERIFY(proxy->startStandbyPlugin(provider));
+    proxy->stopStandbyPlugins();
+
+    delete manager;
+}
+
+void Test::pluginDirectoryChangeTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    QDir pluginDir(QDir::temp());
+    pluginDir.mkdir("accountsetup-plugins");
+    QVERIFY(pluginDir.cd("accountsetup-plugins"));
+    pluginDir.remove("testplugin");
+
+    ProviderPluginProxy *proxy = new ProviderPluginProxy(manager);
+    proxy->setPluginDirectories(QStringList() << pluginDir.path());
+    QSignalSpy spy(proxy, SIGNAL(finished()));
+
+    proxy->createAccount(provider, QString());
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(proxy->error(), ProviderPluginProxy::PluginNotFound);
+
+    /* installing the plugin must invalidate the cached resolution */
+    QVERIFY(QFile::copy("/usr/lib/AccountSetup/testplugin",
+                        pluginDir.filePath("testplugin")));
+    QTest::qWait(500);
+
+    proxy->createAccount(provider, QString());
+    QVERIFY(proxy->isPluginRunning());
+    QCOMPARE(proxy->pluginName(), QString("testplugin"));
+
+    QEventLoop loop;
+    QObject::connect(proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+    loop.exec();
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(proxy->error(), ProviderPluginProxy::NoError);
+
+    pluginDir.remove("testplugin");
+    delete manager;
+}
+
+void Test::prepareTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    QDir pluginDir(QDir::temp());
+    pluginDir.mkdir("accountsetup-prepare");
+    QVERIFY(pluginDir.cd("accountsetup-prepare"));
+    pluginDir.remove("testplugin");
+    QVERIFY(QFile::copy("/usr/lib/AccountSetup/testplugin",
+                        pluginDir.filePath("testplugin")));
+
+    /* the test plugin links to this library */
+    QStringList needed;
+    QStringList searchPath;
+    QVERIFY(PluginPrefetch::readDynamicSection(pluginDir.filePath("testplugin"),
+                                               needed, searchPath));
+    QVERIFY(!needed.filter("libAccountSetup").isEmpty());
+    QVERIFY(PluginPrefetch::prefetch(pluginDir.filePath("testplugin")) > 1);
+    QCOMPARE(PluginPrefetch::prefetch(pluginDir.filePath("missing")), 0);
+
+    ProviderPluginProxy *proxy = new ProviderPluginProxy(manager);
+    proxy->setPluginDirectories(QStringList() << pluginDir.path());
+    QSignalSpy spy(proxy, SIGNAL(finished()));
+
+    QVERIFY(!proxy->prepare(Provider()));
+    QVERIFY(proxy->prepare(provider));
+    QThreadPool::globalInstance()->waitForDone();
+    /* let the resolver watch the directories */
+    QTest::qWait(100);
+
+    proxy->createAccount(provider, QString());
+    QVERIFY(proxy->isPluginRunning());
+    QCOMPARE(proxy->pluginName(), QString("testplugin"));
+
+    QEventLoop loop;
+    QObject::connect(proxy, SIGNAL(finished()), &loop, SLOT(quit()));
+    QTimer::singleShot(10*1000, &loop, SLOT(quit()));
+    loop.exec();
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(proxy->error(), ProviderPluginProxy::NoError);
+
+    /* what was resolved in the worker thread must follow the changes */
+    pluginDir.remove("testplugin");
+    QTest::qWait(500);
+
+    proxy->createAccount(provider, QString());
+    QCOMPARE(spy.count(), 2);
+    QCOMPARE(proxy->error(), ProviderPluginProxy::PluginNotFound);
+
+    delete manager;
+}
+
+void Test::concurrentSessionsTest()
+{
+    const int sessionCount = 30;
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QObject::connect(proxy,
+                     SIGNAL(finished(AccountSetup::ProviderPluginSession*)),
+                     this,
+                     SLOT(onSessionFinished(AccountSetup::ProviderPluginSession*)));
+
+    sessionIndexes.clear();
+    sessionErrors.clear();
+
+    /* every session gets its own parameters */
+    for (int i = 0; i < sessionCount; i++) {
+        const QString dumpFile = QString("/tmp/testplugin-%1.dump").arg(i);
+        QFile::remove(dumpFile);
+        proxy->setDumpFile(dumpFile);
+
+        ProviderPluginSession *session =
+            proxy->createAccount(provider, QString("Service%1").arg(i));
+        QVERIFY(session != 0);
+        QVERIFY(session->isRunning());
+        QCOMPARE(session->setupType(), CreateNew);
+        sessionIndexes.insert(session, i);
+    }
+    QVERIFY(proxy->isPluginRunning());
+
+    /* the plugins inherit their channels: no named server is needed */
+    QStringList servers = QDir::temp().entryList(
+        QStringList(QString("*%1*").arg(getpid())), QDir::System);
+    QCOMPARE(servers.count(), 0);
+
+    QTime timer;
+    timer.start();
+    while (sessionErrors.count() < sessionCount && timer.elapsed() < 30*1000)
+        QTest::qWait(100);
+
+    QCOMPARE(sessionErrors.count(), sessionCount);
+    QVERIFY(!proxy->isPluginRunning());
+
+    for (int i = 0; i < sessionCount; i++) {
+        QCOMPARE(sessionErrors.value(i), (int)ProviderPluginProxy::NoError);
+
+        QSettings status(QString("/tmp/testplugin-%1.dump").arg(i));
+        QCOMPARE(status.value("ping").toString(), QString("pong"));
+        QCOMPARE(status.value("ServiceType").toString(),
+                 QString("Service%1").arg(i));
+    }
+
+    /* the sessions are the caller's: all of them are still there */
+    foreach (ProviderPluginSession *session, sessionIndexes.keys()) {
+        QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+        QCOMPARE(session->providerName(), QString("NutProvider"));
+        delete session;
+    }
+
+    delete manager;
+}
+
+void Test::channelMessagesTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    proxy->setEchoMode();
+
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QSignalSpy progressSpy(session, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy partialSpy(session,
+                          SIGNAL(partialResultReceived(const QVariant &)));
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+
+    /* the plugin tells when it's ready */
+    QVERIFY(waitForSignal(progressSpy, 1));
+    QCOMPARE(progressSpy.at(0).at(0).value<QVariant>().toString(),
+             QString("ready"));
+
+    /* parameters go to the running plugin, which sends them back */
+    QVariantMap parameters;
+    parameters.insert("user", QString("nut"));
+    parameters.insert("count", 3);
+    session->updateParameters(parameters);
+    QVERIFY(waitForSignal(partialSpy, 1));
+    QCOMPARE(partialSpy.at(0).at(0).value<QVariant>().toMap(), parameters);
+    QVERIFY(session->isRunning());
+
+    /* the plugin doesn't handle cancellation itself: it must just quit */
+    session->requestCancel();
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QVERIFY(!session->isRunning());
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    delete manager;
+}
+
+void Test::largeExitDataTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    /* below and above the size at which a shared buffer is used */
+    QList<int> sizes;
+    sizes << 1024 << 4 * 1024 * 1024;
+
+    foreach (int size, sizes) {
+        proxy->setExitDataSize(size);
+
+        ProviderPluginSession *session = proxy->createAccount(provider, QString());
+        QSignalSpy finishedSpy(session, SIGNAL(finished()));
+        QVERIFY(waitForSignal(finishedSpy, 1, 30*1000));
+
+        QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+        QByteArray exitData = session->exitData().toByteArray();
+        QCOMPARE(exitData.size(), size);
+        QCOMPARE(exitData, QByteArray(size, 'x'));
+    }
+
+    delete manager;
+}
+
+void Test::sharedResultErrorTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    /* a result which cannot be read must not pass for an empty one */
+    QStringList kinds;
+    kinds << "unsealed" << "short" << "missing";
+
+    foreach (const QString &kind, kinds) {
+        proxy->setParameters(QStringList() << "--bad-shared-result" << kind);
+
+        ProviderPluginSession *session = proxy->createAccount(provider, QString());
+        QSignalSpy finishedSpy(session, SIGNAL(finished()));
+        QVERIFY(waitForSignal(finishedSpy, 1));
+
+        QCOMPARE(session->error(), ProviderPluginProxy::ResultLost);
+        QVERIFY(!session->exitData().isValid());
+        QCOMPARE(session->createdAccountId(), AccountId(0));
+    }
+
+    delete manager;
+}
+
+void Test::batchTest()
+{
+    const int jobCount = 6;
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    ProviderPluginBatch *batch = proxy->createBatch();
+    batch->setParallelism(2);
+    QCOMPARE(batch->parallelism(), 2);
+
+    for (int i = 0; i < jobCount; i++) {
+        const QString dumpFile =
+            QString("/tmp/testplugin-batch-%1.dump").arg(i);
+        QFile::remove(dumpFile);
+
+        QStringList parameters;
+        parameters << "--config-file" << dumpFile;
+        QCOMPARE(batch->addJob(provider, QString("Service%1").arg(i),
+                               parameters), i);
+    }
+    QCOMPARE(batch->jobCount(), jobCount);
+
+    QSignalSpy jobSpy(batch, SIGNAL(jobFinished(int)));
+    QSignalSpy finishedSpy(batch, SIGNAL(finished()));
+    batch->start();
+    QVERIFY(batch->isRunning());
 
+    /* jobs cannot be added to a running batch */
+    QCOMPARE(batch->addJob(provider), -1);
+
+    QVERIFY(waitForSignal(finishedSpy, 1, 30*1000));
+    QCOMPARE(jobSpy.count(), jobCount);
+    QVERIFY(!batch->isRunning());
+    QVERIFY(!proxy->isPluginRunning());
+
+    QList<ProviderPluginResult> results = batch->results();
+    QCOMPARE(results.count(), jobCount);
+    qint64 longestJob = 0;
+    for (int i = 0; i < jobCount; i++) {
+        QVERIFY(results[i].isFinished());
+        QCOMPARE(results[i].error(), ProviderPluginProxy::NoError);
+        QCOMPARE(results[i].providerName(), provider.name());
+        QCOMPARE(results[i].serviceType(), QString("Service%1").arg(i));
+        longestJob = qMax(longestJob, results[i].elapsed());
+
+        QSettings status(QString("/tmp/testplugin-batch-%1.dump").arg(i));
+        QCOMPARE(status.value("ping").toString(), QString("pong"));
+        QCOMPARE(status.value("ServiceType").toString(),
+                 QString("Service%1").arg(i));
+    }
+    QVERIFY(batch->elapsed() >= longestJob);
+
+    delete manager;
+}
+
+void Test::inProcessPluginTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("InProcessProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QVERIFY(!proxy->inProcessPluginsEnabled());
+
+    const QString dumpFile("/tmp/testplugin-inprocess.dump");
+    proxy->setDumpFile(dumpFile);
+
+    /* unless enabled, the executable is used */
+    ProviderPluginSession *session =
+        proxy->createAccount(provider, "InProcessService");
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QVERIFY(session->exitData().toString() != QString("in-process"));
+
+    QFile::remove(dumpFile);
+    proxy->setInProcessPluginsEnabled(true);
+    QVERIFY(proxy->inProcessPluginsEnabled());
+
+    session = proxy->createAccount(provider, "InProcessService");
+    QVERIFY(session->isRunning());
+    QCOMPARE(session->pluginName(), QString("libtestplugin.so"));
+
+    QSignalSpy inProcessSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(inProcessSpy, 1));
+    QVERIFY(!session->isRunning());
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QCOMPARE(session->exitData().toString(), QString("in-process"));
+
+    QSettings status(dumpFile);
+    QCOMPARE(status.value("ping").toString(), QString("pong"));
+    QCOMPARE(status.value("SetupType").toInt(), (int)CreateNew);
+    QCOMPARE(status.value("ServiceType").toString(),
+             QString("InProcessService"));
+    QCOMPARE(status.value("Pid").toLongLong(),
+             (qint64)QCoreApplication::applicationPid());
+
+    delete manager;
+}
+
+void Test::traceTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QVERIFY(!proxy->tracingEnabled());
+
+    /* nothing is recorded unless enabled */
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QSignalSpy untracedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(untracedSpy, 1));
+    QVERIFY(session->traceEvents().isEmpty());
+    QVERIFY(proxy->traceEvents().isEmpty());
+
+    proxy->setTracingEnabled(true);
+    QVERIFY(proxy->tracingEnabled());
+
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    QHash<QString, ProviderPluginTraceEvent> events;
+    foreach (const ProviderPluginTraceEvent &event, session->traceEvents())
+        events.insert(event.name, event);
+
+    QStringList proxyPhases;
+    proxyPhases << "session-created" << "plugin-resolved" <<
+        "result-received" << "finished";
+    foreach (const QString &phase, proxyPhases) {
+        QVERIFY2(events.contains(phase), qPrintable(phase));
+        QVERIFY(!events[phase].fromPlugin);
+        QCOMPARE(events[phase].pid,
+                 (qint64)QCoreApplication::applicationPid());
+    }
+
+    QStringList pluginPhases;
+    pluginPhases << "plugin-created" << "channel-open" << "ui-ready" <<
+        "result-sent";
+    foreach (const QString &phase, pluginPhases) {
+        QVERIFY2(events.contains(phase), qPrintable(phase));
+        QVERIFY(events[phase].fromPlugin);
+        QVERIFY(events[phase].pid != QCoreApplication::applicationPid());
+    }
+
+    /* both sides use the same clock */
+    QVERIFY(events["session-created"].timestamp <=
+            events["plugin-created"].timestamp);
+    QVERIFY(events["plugin-created"].timestamp <=
+            events["result-sent"].timestamp);
+    QVERIFY(events["result-sent"].timestamp <=
+            events["result-received"].timestamp);
+
+    QCOMPARE(proxy->traceEvents().count(), session->traceEvents().count());
+
+    const QString traceFile("/tmp/libaccountsetup-trace.json");
+    QVERIFY(proxy->writeChromeTrace(traceFile));
+    QFile file(traceFile);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QByteArray contents = file.readAll();
+    QVERIFY(contents.startsWith("{\"traceEvents\":["));
+    QVERIFY(contents.contains("\"name\":\"result-sent\",\"cat\":\"plugin\""));
+    file.remove();
+
+    proxy->clearTraceEvents();
+    QVERIFY(proxy->traceEvents().isEmpty());
+
+    delete manager;
+}
+
+/*
+ * Runs the given number of plugin cycles with the proxy, and returns the
+ * number of those which failed.
+ */
+static int runCycles(ProviderPluginProxyTest *proxy, Provider provider,
+                     Account *account, int cycles)
+{
+    int failures = 0;
+    for (int i = 0; i < cycles; i++) {
+        ProviderPluginSession *session;
+        switch (i % 4) {
+        case 0:
+            session = proxy->createAccount(provider, QString());
+            break;
+        case 1:
+            session = proxy->editAccount(account, QString());
+            break;
+        case 2:
+            proxy->startStandbyPlugin(provider);
+            session = proxy->createAccount(provider, QString());
+            break;
+        default:
+            /* killed while running: it never finishes */
+            session = proxy->createAccount(provider, QString());
+            proxy->kill();
+            delete session;
+            continue;
+        }
+
+        QSignalSpy finishedSpy(session, SIGNAL(finished()));
+        if (!waitForSignal(finishedSpy, 1) ||
+            session->error() != ProviderPluginProxy::NoError)
+            failures++;
+        delete session;
+    }
+
+    /* the killed plugins are still being reaped */
+    QTime timer;
+    timer.start();
+    while (childProcesses(false) > 0 && timer.elapsed() < 10000)
+        QTest::qWait(10);
+    return failures;
+}
+
+void Test::launchParametersTest()
+{
+    Manager *manager = new Manager();
+
+    Account *account = manager->createAccount("NutProvider");
+    account->setDisplayName("Launched");
+    account->sync();
+    QVERIFY(account->id() != 0);
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    const QString dumpFile("/tmp/testplugin-launch.dump");
+    QFile::remove(dumpFile);
+    proxy->setDumpFile(dumpFile);
+
+    /* larger than any single command line argument can be */
+    QVariantMap parameters;
+    parameters.insert("blob", QByteArray(256 * 1024, 'p'));
+    parameters.insert("count", 7);
+    proxy->setLaunchParameters(parameters);
+    QCOMPARE(proxy->launchParameters(), parameters);
+
+    ProviderPluginSession *session =
+        proxy->editAccount(account, "LaunchService");
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QCOMPARE(session->createdAccountId(), account->id());
+
+    QSettings status(dumpFile);
+    QCOMPARE(status.value("ping").toString(), QString("pong"));
+    QCOMPARE(status.value("SetupType").toInt(), (int)EditExisting);
+    QCOMPARE(status.value("AccountId").toUInt(), account->id());
+    QCOMPARE(status.value("ServiceType").toString(), QString("LaunchService"));
+    QCOMPARE(status.value("Parameters").toMap(), parameters);
+    QCOMPARE(status.value("SnapshotDisplayName").toString(),
+             QString("Launched"));
+
+    account->remove();
+    account->sync();
+    delete manager;
+}
+
+void Test::outputCaptureTest()
+{
+    const int outputSize = 200 * 1024;
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QCOMPARE(proxy->outputSink(), ProviderPluginProxy::LogOutput);
+    QCOMPARE(proxy->outputBufferSize(), 64 * 1024);
+
+    /* the output of a crashed plugin is kept, even if discarded */
+    proxy->setOutputSink(ProviderPluginProxy::DiscardOutput);
+    proxy->setParameters(QStringList() << "--output-size" <<
+                         QString::number(outputSize) << "--crash");
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QSignalSpy crashedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(crashedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::PluginCrashed);
+
+    QByteArray output = proxy->lastOutput(1024);
+    QCOMPARE(output.size(), 1024);
+    QVERIFY(output.endsWith("last words\n"));
+    QCOMPARE(proxy->lastOutput().size(), proxy->outputBufferSize());
+    QCOMPARE(session->lastOutput(), proxy->lastOutput());
+
+    /* all of it goes to the signal sink, when not limited */
+    proxy->setOutputSink(ProviderPluginProxy::SignalOutput);
+    proxy->setOutputRateLimit(0);
+    proxy->setParameters(QStringList() << "--output-size" <<
+                         QString::number(outputSize));
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy outputSpy(session, SIGNAL(outputReceived(const QByteArray &)));
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    QByteArray received;
+    for (int i = 0; i < outputSpy.count(); i++)
+        received += outputSpy.at(i).at(0).toByteArray();
+    QCOMPARE(received.size(), outputSize + int(strlen("last words\n")));
+
+    /* with a limit, the sink gets less than that */
+    proxy->setOutputRateLimit(1024);
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy limitedSpy(session, SIGNAL(outputReceived(const QByteArray &)));
+    QSignalSpy limitedFinishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(limitedFinishedSpy, 1));
+
+    received.clear();
+    for (int i = 0; i < limitedSpy.count(); i++)
+        received += limitedSpy.at(i).at(0).toByteArray();
+    QVERIFY(received.size() < outputSize);
+
+    delete manager;
+}
+
+void Test::cancelTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    /* a plugin which quits when asked to */
+    proxy->setEchoMode();
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QSignalSpy readySpy(session, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(readySpy, 1));
+
+    QTime timer;
+    timer.start();
+    session->cancel(5000);
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QVERIFY(timer.elapsed() < 5000);
+    QCOMPARE(session->error(), ProviderPluginProxy::Cancelled);
+    QVERIFY(!session->isRunning());
+
+    /* one which ignores the request and SIGTERM, and must be killed */
+    proxy->setParameters(QStringList() << "--echo" << "--stubborn");
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy stubbornReadySpy(session,
+                                SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy stubbornSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(stubbornReadySpy, 1));
+
+    timer.start();
+    session->cancel(300);
+    /* the caller is never blocked */
+    QVERIFY(timer.elapsed() < 100);
+    QVERIFY(session->isRunning());
+    QVERIFY(waitForSignal(stubbornSpy, 1));
+    QVERIFY(timer.elapsed() >= 600);
+    QCOMPARE(session->error(), ProviderPluginProxy::Cancelled);
+
+    /* deleting the proxy with a plugin running doesn't wait for it */
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy lastReadySpy(session,
+                            SIGNAL(progressReported(const QVariant &)));
+    QVERIFY(waitForSignal(lastReadySpy, 1));
+    timer.start();
+    delete proxy;
+    QVERIFY(timer.elapsed() < 100);
+
+    QTest::qWait(500);
+    QCOMPARE(zombieChildren(), 0);
+
+    delete manager;
+}
+
+void Test::spawnLauncherTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QCOMPARE(proxy->launcher(), ProviderPluginProxy::ForkLauncher);
+    proxy->setLauncher(ProviderPluginProxy::SpawnLauncher);
+    QCOMPARE(proxy->launcher(), ProviderPluginProxy::SpawnLauncher);
+
+    /* the result comes through the inherited channel */
+    const QString dumpFile("/tmp/testplugin-spawn.dump");
+    QFile::remove(dumpFile);
+    proxy->setDumpFile(dumpFile);
+    ProviderPluginSession *session =
+        proxy->createAccount(provider, QString("AnyServiceType"));
+    QSignalSpy finishedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(finishedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QSettings status(dumpFile);
+    QCOMPARE(status.value("ServiceType").toString(), QString("AnyServiceType"));
+
+    /* crashes and the output before them are seen as with QProcess */
+    proxy->setOutputSink(ProviderPluginProxy::DiscardOutput);
+    proxy->setParameters(QStringList() << "--output-size" << "100000" <<
+                         "--crash");
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy crashedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(crashedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::PluginCrashed);
+    QVERIFY(session->lastOutput().endsWith("last words\n"));
+
+    /* standby plugins are spawned too */
+    proxy->setParameters(QStringList());
+    QVERIFY(proxy->startStandbyPlugin(provider));
+    QTest::qWait(200);
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy standbySpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(standbySpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    /* and so is the escalation of a cancellation */
+    proxy->setParameters(QStringList() << "--echo" << "--stubborn");
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy readySpy(session, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy cancelledSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(readySpy, 1));
+    session->cancel(300);
+    QVERIFY(waitForSignal(cancelledSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::Cancelled);
+
+    /* a plugin which cannot be started */
+    QDir emptyDir(QDir::temp());
+    emptyDir.mkdir("accountsetup-spawn");
+    QVERIFY(emptyDir.cd("accountsetup-spawn"));
+    QFile fake(emptyDir.filePath("testplugin"));
+    QVERIFY(fake.open(QIODevice::WriteOnly));
+    fake.close();
+    proxy->setPluginDirectories(QStringList() << emptyDir.path());
+    proxy->setParameters(QStringList());
+    session = proxy->createAccount(provider, QString());
+    QSignalSpy failedSpy(session, SIGNAL(finished()));
+    QVERIFY(waitForSignal(failedSpy, 1));
+    QCOMPARE(session->error(), ProviderPluginProxy::PluginCrashed);
+    fake.remove();
+
+    delete proxy;
+    QTest::qWait(500);
+    QCOMPARE(zombieChildren(), 0);
+
+    delete manager;
+}
+
+void Test::asyncTest()
+{
+    const int callCount = 8;
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    /* from the thread of the proxy, through a watcher */
+    QFutureWatcher<ProviderPluginResult> watcher;
+    QSignalSpy watcherSpy(&watcher, SIGNAL(finished()));
+    watcher.setFuture(proxy->createAccountAsync(provider, "AnyServiceType"));
+    QVERIFY(waitForSignal(watcherSpy, 1));
+    ProviderPluginResult result = watcher.result();
+    QVERIFY(result.isFinished());
+    QCOMPARE(result.error(), ProviderPluginProxy::NoError);
+    QCOMPARE(result.providerName(), QString("NutProvider"));
+    QCOMPARE(result.serviceType(), QString("AnyServiceType"));
+
+    /* errors are results too */
+    QFuture<ProviderPluginResult> failed =
+        proxy->editAccountAsync(0, QString());
+    QVERIFY(failed.isFinished());
+    QCOMPARE(failed.result().error(), ProviderPluginProxy::AccountNotFound);
+
+    /* in its own thread, a session is never waited for: only polled */
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QTest::ignoreMessage(QtWarningMsg,
+                         "ProviderPluginSession::waitForFinished: cannot "
+                         "wait in the thread of the session; use the "
+                         "finished() signal, or "
+                         "ProviderPluginProxy::createAccountAsync()");
+    QVERIFY(!session->waitForFinished(10000));
+    QVERIFY(session->isRunning());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    /* once finished, there's nothing to wait for */
+    QVERIFY(session->waitForFinished(10000));
+
+    proxy->setEchoMode();
+    session = proxy->createAccount(provider, QString());
+    session->cancel(100);
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::Cancelled);
+
+    /* from another thread, which never runs an event loop */
+    proxy->setParameters(QStringList());
+    session = proxy->createAccount(provider, QString());
+    AsyncCaller caller(proxy, provider, callCount, session);
+    caller.start();
+    QTime timer;
+    timer.start();
+    while (!caller.isFinished() && timer.elapsed() < 30000)
+        QTest::qWait(10);
+    QVERIFY(caller.wait(1000));
+
+    QVERIFY(caller.sessionFinished());
+    QCOMPARE(caller.results().count(), callCount);
+    for (int i = 0; i < callCount; i++) {
+        QCOMPARE(caller.results()[i].error(), ProviderPluginProxy::NoError);
+        QCOMPARE(caller.results()[i].serviceType(), QString::number(i));
+    }
+    delete session;
+
+    /* plugins still running when the proxy goes away are cancelled */
+    proxy->setEchoMode();
+    QFuture<ProviderPluginResult> orphan =
+        proxy->createAccountAsync(provider, QString());
+    delete proxy;
+    QVERIFY(orphan.isFinished());
+    QCOMPARE(orphan.result().error(), ProviderPluginProxy::Cancelled);
+
+    delete manager;
+}
+
+void Test::serverModeTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    proxy->setIdlePluginLimit(1);
+    QCOMPARE(proxy->idlePluginLimit(), 1);
+
+    const QString dumpFile("/tmp/testplugin-server.dump");
+    QFile::remove(dumpFile);
+    QStringList parameters;
+    parameters << "--serve" << "--config-file" << dumpFile;
+    proxy->setParameters(parameters);
+
+    /* the second request is served by the same process */
+    ProviderPluginSession *session =
+        proxy->createAccount(provider, "FirstServiceType");
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QSettings first(dumpFile);
+    qint64 pid = first.value("Pid").toLongLong();
+    QVERIFY(pid > 0);
+    QCOMPARE(first.value("Requests").toInt(), 1);
+
+    session = proxy->createAccount(provider, "SecondServiceType");
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QSettings second(dumpFile);
+    QCOMPARE(second.value("Pid").toLongLong(), pid);
+    QCOMPARE(second.value("Requests").toInt(), 2);
+    QCOMPARE(second.value("SetupType").toInt(), (int)CreateNew);
+    QCOMPARE(second.value("ServiceType").toString(),
+             QString("SecondServiceType"));
+
+    /* idle plugins are stopped after the timeout */
+    proxy->setIdlePluginTimeout(100);
+    QTime timer;
+    timer.start();
+    while (::kill(pid_t(pid), 0) == 0 && timer.elapsed() < 5000)
+        QTest::qWait(50);
+    /* a zombie would still accept the signal */
+    QVERIFY(::kill(pid_t(pid), 0) != 0);
+
+    session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSession(session));
+    QSettings restarted(dumpFile);
+    QVERIFY(restarted.value("Pid").toLongLong() != pid);
+    QCOMPARE(restarted.value("Requests").toInt(), 1);
+
+    /* plugins which don't serve requests exit as usual */
+    proxy->setParameters(QStringList());
+    session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    proxy->stopStandbyPlugins();
+    delete manager;
+}
+
+void Test::metricsTest()
+{
+    /* the metrics are kept for the whole process, so only what this test
+     * adds to them is checked */
+    QVariantMap before = ProviderPluginProxy::metrics();
+
+    Manager *manager = new Manager();
+
+    Provider missing = manager->provider("MissingPlugin");
+    QVERIFY(missing.isValid());
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    ProviderPluginSession *session = proxy->createAccount(missing, QString());
+    QCOMPARE(session->error(), ProviderPluginProxy::PluginNotFound);
+
+    proxy->setExitDataSize(100000);
+    session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+
+    proxy->setParameters(QStringList() << "--crash");
+    session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::PluginCrashed);
+
+    session = proxy->editAccount(0, QString());
+    QCOMPARE(session->error(), ProviderPluginProxy::AccountNotFound);
+
+    QVariantMap after = ProviderPluginProxy::metrics();
+    QVariantMap oldTotal = before.value("total").toMap();
+    QVariantMap total = after.value("total").toMap();
+    QCOMPARE(countDelta(oldTotal, total, "launches"), 2);
+    QCOMPARE(countDelta(oldTotal, total, "succeeded"), 1);
+    QCOMPARE(countDelta(oldTotal, total, "pluginNotFound"), 1);
+    QCOMPARE(countDelta(oldTotal, total, "pluginCrashed"), 1);
+    QCOMPARE(countDelta(oldTotal, total, "failedToStart"), 0);
+    QCOMPARE(countDelta(oldTotal, total, "accountNotFound"), 1);
+    QCOMPARE(countDelta(oldTotal, total, "other"), 0);
+
+    /* only the plugins which ran have a duration */
+    QVariantMap duration = total.value("duration").toMap();
+    QCOMPARE(countDelta(oldTotal.value("duration").toMap(), duration,
+                        "count"), 2);
+    QVERIFY(duration.value("p99").toLongLong() <=
+            duration.value("max").toLongLong());
+    QVariantMap payloadSize = total.value("payloadSize").toMap();
+    QCOMPARE(countDelta(oldTotal.value("payloadSize").toMap(), payloadSize,
+                        "count"), 1);
+    QVERIFY(payloadSize.value("max").toInt() > 100000);
+
+    QVariantMap oldProviders = before.value("providers").toMap();
+    QVariantMap providers = after.value("providers").toMap();
+    QCOMPARE(countDelta(oldProviders.value("MissingPlugin").toMap(),
+                        providers.value("MissingPlugin").toMap(),
+                        "pluginNotFound"), 1);
+    QCOMPARE(countDelta(oldProviders.value("NutProvider").toMap(),
+                        providers.value("NutProvider").toMap(),
+                        "launches"), 2);
+    QVariantMap oldPlugins = before.value("plugins").toMap();
+    QVariantMap plugins = after.value("plugins").toMap();
+    int crashed = 0;
+    QVariantMap::const_iterator i;
+    for (i = plugins.constBegin(); i != plugins.constEnd(); ++i)
+        crashed += countDelta(oldPlugins.value(i.key()).toMap(),
+                              i.value().toMap(), "pluginCrashed");
+    QCOMPARE(crashed, 1);
+
+    delete manager;
+}
+
+void Test::accountReadyTest()
+{
+    qRegisterMetaType<Accounts::AccountId>("Accounts::AccountId");
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+    QSignalSpy readySpy(proxy, SIGNAL(accountReady(Accounts::AccountId)));
+
+    /* reported by the plugin, while it's still running */
+    proxy->setParameters(QStringList() << "--store-account");
+    ProviderPluginSession *session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSignal(readySpy, 1));
+    QVERIFY(session->isRunning());
+    AccountId accountId = readySpy.at(0).at(0).value<AccountId>();
+    QVERIFY(accountId != 0);
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->createdAccountId(), accountId);
+    QCOMPARE(readySpy.count(), 1);
+
+    /* taken from the result otherwise */
+    Account *account = manager->account(accountId);
+    QVERIFY(account != 0);
+    readySpy.clear();
+    proxy->setParameters(QStringList());
+    session = proxy->editAccount(account, QString());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(readySpy.count(), 1);
+    QCOMPARE(readySpy.at(0).at(0).value<AccountId>(), accountId);
+
+    /* nothing stored, nothing to report */
+    readySpy.clear();
+    session = proxy->createAccount(provider, QString());
+    QVERIFY(waitForSession(session));
+    QCOMPARE(session->error(), ProviderPluginProxy::NoError);
+    QCOMPARE(readySpy.count(), 0);
+
+    account->remove();
+    account->sync();
+    delete manager;
+}
+
+void Test::schedulerTest()
+{
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    ProviderPluginProxyTest *interactive = new ProviderPluginProxyTest(manager);
+    interactive->setEchoMode();
+    ProviderPluginProxyTest *background = new ProviderPluginProxyTest(manager);
+    background->setEchoMode();
+    background->setPriority(ProviderPluginProxy::BackgroundPriority);
+    QCOMPARE(background->priority(), ProviderPluginProxy::BackgroundPriority);
+
+    ProviderPluginProxy::setMaxRunningPlugins(1);
+    QCOMPARE(ProviderPluginProxy::maxRunningPlugins(), 1);
+
+    ProviderPluginSession *first = interactive->createAccount(provider,
+                                                              QString());
+    QSignalSpy firstReady(first, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy firstFinished(first, SIGNAL(finished()));
+    ProviderPluginSession *batch1 = background->createAccount(provider,
+                                                              QString());
+    QSignalSpy batch1Ready(batch1,
+                           SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy batch1Finished(batch1, SIGNAL(finished()));
+    ProviderPluginSession *batch2 = background->createAccount(provider,
+                                                              QString());
+    QSignalSpy batch2Finished(batch2, SIGNAL(finished()));
+    ProviderPluginSession *second = interactive->createAccount(provider,
+                                                               QString());
+    QSignalSpy secondReady(second, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy secondFinished(second, SIGNAL(finished()));
+
+    /* waiting plugins count as running, but aren't launched */
+    QVERIFY(waitForSignal(firstReady, 1));
+    QTest::qWait(200);
+    QVERIFY(batch1->isRunning());
+    QVERIFY(second->isRunning());
+    QCOMPARE(batch1Ready.count(), 0);
+    QCOMPARE(secondReady.count(), 0);
+    QCOMPARE(first->queueTime(), qint64(0));
+
+    /* interactive launches overtake the background ones */
+    first->requestCancel();
+    QVERIFY(waitForSignal(firstFinished, 1));
+    QVERIFY(waitForSignal(secondReady, 1));
+    QCOMPARE(batch1Ready.count(), 0);
+    QVERIFY(second->queueTime() >= 200);
+
+    second->requestCancel();
+    QVERIFY(waitForSignal(secondFinished, 1));
+    QVERIFY(waitForSignal(batch1Ready, 1));
+
+    /* a waiting plugin is cancelled right away */
+    batch2->cancel();
+    QCOMPARE(batch2Finished.count(), 1);
+    QCOMPARE(batch2->error(), ProviderPluginProxy::Cancelled);
+    QVERIFY(!batch2->isRunning());
+
+    batch1->requestCancel();
+    QVERIFY(waitForSignal(batch1Finished, 1));
+    ProviderPluginProxy::setMaxRunningPlugins(0);
+
+    /* a plugin larger than the budget runs, but alone */
+    ProviderPluginProxy::setPluginMemoryBudget(1);
+    QCOMPARE(ProviderPluginProxy::pluginMemoryBudget(), qint64(1));
+    first = interactive->createAccount(provider, QString());
+    QSignalSpy largeReady(first, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy largeFinished(first, SIGNAL(finished()));
+    second = interactive->createAccount(provider, QString());
+    QSignalSpy nextReady(second, SIGNAL(progressReported(const QVariant &)));
+    QSignalSpy nextFinished(second, SIGNAL(finished()));
+    QVERIFY(waitForSignal(largeReady, 1));
+    QTest::qWait(200);
+    QCOMPARE(nextReady.count(), 0);
+
+    /* raising the budget lets the next one in */
+    ProviderPluginProxy::setPluginMemoryBudget(0);
+    QVERIFY(waitForSignal(nextReady, 1));
+
+    first->requestCancel();
+    second->requestCancel();
+    QVERIFY(waitForSignal(largeFinished, 1));
+    QVERIFY(waitForSignal(nextFinished, 1));
+
+    delete manager;
+}
+
+void Test::soakTest()
+{
+    /* Short by default; set ACCOUNTSETUP_SOAK_CYCLES to a few thousands
+     * for an actual soak run, which takes minutes. */
+    int cycles = qgetenv("ACCOUNTSETUP_SOAK_CYCLES").toInt();
+    if (cycles <= 0)
+        cycles = 80;
+    const int warmupCycles = 40;
+    const int fileBudget = 2;
+    const qint64 heapBudget = 2 * 1024 * 1024;
+
+    Manager *manager = new Manager();
+
+    Provider provider = manager->provider("NutProvider");
+    QVERIFY(provider.isValid());
+
+    Account *account = manager->createAccount("NutProvider");
+    account->setDisplayName("Soak");
+    account->sync();
+    QVERIFY(account->id() != 0);
+
+    ProviderPluginProxyTest *proxy = new ProviderPluginProxyTest(manager);
+
+    /* caches and lazily created objects are filled up first */
+    QCOMPARE(runCycles(proxy, provider, account, warmupCycles), 0);
+
+    int files = openFileCount();
+    qint64 heap = heapInUse();
+    int sockets = tmpSocketCount();
+
+    QCOMPARE(runCycles(proxy, provider, account, cycles), 0);
+    proxy->stopStandbyPlugins();
+
+    /* descriptors and sockets go with the deferred deletions */
+    QTime timer;
+    timer.start();
+    while ((childProcesses(false) > 0 ||
+            openFileCount() > files + fileBudget ||
+            tmpSocketCount() > sockets) && timer.elapsed() < 10000)
+        QTest::qWait(10);
+
+    qDebug() << "Open files:" << files << "->" << openFileCount();
+    qDebug() << "Heap:" << heap << "->" << heapInUse();
+
+    QVERIFY(!proxy->isPluginRunning());
+    QVERIFY(openFileCount() <= files + fileBudget);
+    QVERIFY(heapInUse() <= heap + heapBudget);
+    QCOMPARE(zombieChildren(), 0);
+    QVERIFY(tmpSocketCount() <= sockets);
+
+    account->remove();
+    account->sync();
+    delete manager;
+}
+
+QTEST_MAIN(Test)
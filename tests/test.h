@@ -23,14 +23,20 @@
 #ifndef TEST_H
 #define TEST_H
 
+#include <QHash>
 #include <QObject>
 
+namespace AccountSetup {
+class ProviderPluginSession;
+}
+
 class Test : public QObject
 {
     Q_OBJECT
 
 public slots:
     void onFinished();
+    void onSessionFinished(AccountSetup::ProviderPluginSession *session);
 
 private slots:
     void initTestCase();
@@ -38,9 +44,31 @@ private slots:
 
     void missingPluginTest();
     void pluginStatusTest();
+    void standbyPluginTest();
+    void pluginDirectoryChangeTest();
+    void concurrentSessionsTest();
+    void channelMessagesTest();
+    void largeExitDataTest();
+    void sharedResultErrorTest();
+    void batchTest();
+    void inProcessPluginTest();
+    void traceTest();
+    void launchParametersTest();
+    void outputCaptureTest();
+    void cancelTest();
+    void spawnLauncherTest();
+    void asyncTest();
+    void serverModeTest();
+    void metricsTest();
+    void accountReadyTest();
+    void schedulerTest();
+    void soakTest();
+    void prepareTest();
 
 private:
     bool finishedEmitted;
+    QHash<AccountSetup::ProviderPluginSession *, int> sessionIndexes;
+    QHash<int, int> sessionErrors;
 };
 
 #endif
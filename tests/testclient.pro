@@ -11,9 +11,11 @@ CONFIG += \
     qtestlib \
     qt
 SOURCES += \
-    test.cpp
+    test.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-prefetch.cpp
 HEADERS += \
-    test.h
+    test.h \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-prefetch.h
 
 QT += core xml
 
@@ -31,6 +33,7 @@ DEFINES += \
 
 provider.path = $$DATA_PATH
 provider.files += \
+    InProcessProvider.provider \
     MissingPlugin.provider \
     NutProvider.provider
 INSTALLS += provider
@@ -0,0 +1,62 @@
+/*
+ * This file is part of libAccountSetup
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+#include <AccountSetup/ProviderPluginInterface>
+#include <AccountSetup/ProviderPluginProcess>
+#include <QCoreApplication>
+#include <QSettings>
+#include <QtPlugin>
+
+using namespace AccountSetup;
+
+/* The in-process build of the test plugin */
+class TestPlugin: public QObject, public ProviderPluginInterface
+{
+    Q_OBJECT
+    Q_INTERFACES(AccountSetup::ProviderPluginInterface)
+
+public:
+    void start(ProviderPluginProcess *plugin)
+    {
+        /* open a QSettings file as specified by the caller */
+        QStringList args = plugin->arguments();
+        int argIndex = args.indexOf("--config-file");
+        if (argIndex >= 0 && argIndex + 1 < args.length()) {
+            QSettings status(args[argIndex + 1]);
+
+            /* Dump the current status into the QSettings file */
+            status.setValue("ping", QString("pong"));
+            status.setValue("SetupType", plugin->setupType());
+            status.setValue("ServiceType", plugin->serviceType());
+            status.setValue("Pid", QCoreApplication::applicationPid());
+        }
+
+        plugin->setExitData(QString("in-process"));
+
+        /* plugins must not terminate from within start() */
+        QMetaObject::invokeMethod(plugin, "quit", Qt::QueuedConnection);
+    }
+};
+
+Q_EXPORT_PLUGIN2(testplugin, TestPlugin)
+
+#include "testinprocessplugin.moc"
@@ -0,0 +1,21 @@
+include(../common-project-config.pri)
+include($${TOP_SRC_DIR}/common-vars.pri)
+
+TARGET = testplugin
+TEMPLATE = lib
+
+CONFIG += \
+    plugin \
+    qt
+SOURCES += \
+    testinprocessplugin.cpp
+
+QT += core xml
+
+LIBS += -lAccountSetup
+DEPENDPATH += $${INCLUDEPATH}
+PKGCONFIG += \
+    accounts-qt
+
+target.path = /usr/lib/AccountSetup/
+INSTALLS += target
@@ -21,19 +21,152 @@
  */
 
 #include <AccountSetup/ProviderPluginProcess>
+#include "AccountSetup/plugin-channel.h"
 #include <Accounts/Account>
 #include <Accounts/Manager>
 #include <QCoreApplication>
+#include <QDataStream>
 #include <QDebug>
 #include <QSettings>
+#include <QTimer>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 using namespace Accounts;
 using namespace AccountSetup;
 
+/* Sends back the parameters it receives */
+class Echo: public QObject
+{
+    Q_OBJECT
+
+public:
+    Echo(ProviderPluginProcess *plugin, bool stubborn):
+        QObject(plugin),
+        plugin(plugin)
+    {
+        connect(plugin, SIGNAL(parametersUpdated(const QVariantMap &)),
+                this, SLOT(onParametersUpdated(const QVariantMap &)));
+
+        /* a plugin which doesn't want to be cancelled */
+        if (stubborn) {
+            connect(plugin, SIGNAL(cancelRequested()),
+                    this, SLOT(onCancelRequested()));
+            signal(SIGTERM, SIG_IGN);
+        }
+    }
+
+private slots:
+    void onParametersUpdated(const QVariantMap &parameters)
+    {
+        plugin->sendPartialResult(parameters);
+    }
+
+    void onCancelRequested()
+    {
+    }
+
+private:
+    ProviderPluginProcess *plugin;
+};
+
+/* Serves one request after the other, counting them */
+class Server: public QObject
+{
+    Q_OBJECT
+
+public:
+    Server(ProviderPluginProcess *plugin):
+        QObject(plugin),
+        plugin(plugin),
+        requests(0)
+    {
+        connect(plugin, SIGNAL(requestReceived()),
+                this, SLOT(onRequestReceived()));
+    }
+
+public slots:
+    void onRequestReceived()
+    {
+        requests++;
+
+        QStringList args = plugin->arguments();
+        int argIndex = args.indexOf("--config-file");
+        if (argIndex > 0 && argIndex + 1 < args.length()) {
+            QSettings status(args[argIndex + 1]);
+            status.setValue("Pid", QCoreApplication::applicationPid());
+            status.setValue("Requests", requests);
+            status.setValue("SetupType", plugin->setupType());
+            status.setValue("ServiceType", plugin->serviceType());
+        }
+
+        plugin->quit();
+    }
+
+private:
+    ProviderPluginProcess *plugin;
+    int requests;
+};
+
+static int argumentValue(const QStringList &args, const QString &name)
+{
+    int index = args.indexOf(name);
+    return index > 0 && index + 1 < args.length() ?
+        args[index + 1].toInt() : -1;
+}
+
+/* Announces a shared result which cannot be read: "unsealed" sends a memory
+ * file the plugin could still modify, "short" one smaller than announced,
+ * and "missing" no descriptor at all. */
+static int sendBadSharedResult(const QString &kind)
+{
+    QStringList args = QCoreApplication::arguments();
+    PluginChannel *channel =
+        PluginChannel::fromDescriptors(argumentValue(args, "--channelFd"),
+                                       argumentValue(args, "--descriptorFd"));
+    if (channel == 0)
+        return 1;
+
+    QByteArray data(100000, 'x');
+    int fd = -1;
+    if (kind == "unsealed") {
+#ifdef SYS_memfd_create
+        fd = ::syscall(SYS_memfd_create, "testplugin", 0);
+        if (fd >= 0 && ::write(fd, data.constData(), data.size()) < 0) {
+            ::close(fd);
+            fd = -1;
+        }
+#endif
+    } else if (kind == "short") {
+        fd = PluginChannel::createSharedBuffer(data.left(100));
+    }
+    if (fd >= 0) {
+        channel->sendDescriptor(fd);
+        ::close(fd);
+    }
+
+    QByteArray size;
+    QDataStream stream(&size, QIODevice::WriteOnly);
+    stream << quint64(data.size());
+    channel->sendMessage(PluginChannel::SharedResult, size);
+    channel->waitForBytesWritten(10000);
+    delete channel;
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     QCoreApplication app(argc, argv);
 
+    /* before the plugin process takes over the channel */
+    int argIndex = app.arguments().indexOf("--bad-shared-result");
+    if (argIndex > 0 && argIndex + 1 < app.arguments().length())
+        return sendBadSharedResult(app.arguments()[argIndex + 1]);
+
     ProviderPluginProcess *plugin = new ProviderPluginProcess();
 
     /* test basic functionality */
@@ -41,9 +174,25 @@ int main(int argc, char **argv)
         qFatal("ProviderPluginProcess::instance returned wrong instance");
     }
 
+    QStringList args = plugin->arguments();
+
+    /* stay around for more requests, if the caller allows it */
+    if (args.contains("--serve")) {
+        Server *server = new Server(plugin);
+        QTimer::singleShot(0, server, SLOT(onRequestReceived()));
+        app.exec();
+        delete plugin;
+        return 0;
+    }
+
+    /* A real plugin would show its UI here; with --account-first, the
+     * account is loaded before, as if it were needed to draw the UI. */
+    if (args.contains("--account-first"))
+        plugin->account();
+    plugin->reportUiReady();
+
     /* open a QSettings file as specified by the parent process */
-    QStringList args = QCoreApplication::arguments();
-    int argIndex = args.indexOf("--config-file");
+    argIndex = args.indexOf("--config-file");
     if (argIndex > 0 && argIndex + 1 < args.length()) {
         QSettings status(args[argIndex + 1]);
 
@@ -54,9 +203,51 @@ int main(int argc, char **argv)
         status.setValue("ServiceType", plugin->serviceType());
         status.setValue("ParentWindowId",
                         QVariant::fromValue<uint>(plugin->parentWindowId()));
+        status.setValue("Parameters", plugin->parameters());
+        status.setValue("Arguments", args);
+        status.setValue("CommandLine", QCoreApplication::arguments());
+        status.setValue("SnapshotDisplayName",
+                        plugin->accountSnapshot().value("displayName"));
+    }
+
+    /* return as much data as requested by the parent process */
+    argIndex = args.indexOf("--exit-data-size");
+    if (argIndex > 0 && argIndex + 1 < args.length()) {
+        plugin->setExitData(QByteArray(args[argIndex + 1].toInt(), 'x'));
+    }
+
+    /* write as much output as requested, and maybe crash */
+    argIndex = args.indexOf("--output-size");
+    if (argIndex > 0 && argIndex + 1 < args.length()) {
+        QByteArray output(args[argIndex + 1].toInt(), 'o');
+        fwrite(output.constData(), 1, output.size(), stderr);
+        fprintf(stdout, "last words\n");
+        fflush(stdout);
+    }
+    if (args.contains("--crash"))
+        abort();
+
+    /* store the account, and then take long to shut down */
+    if (args.contains("--store-account")) {
+        Account *account = plugin->account();
+        account->setDisplayName("Stored");
+        account->sync();
+        plugin->reportAccountReady();
+        usleep(500 * 1000);
+    }
+
+    /* keep running until cancelled by the parent process */
+    if (args.contains("--echo")) {
+        new Echo(plugin, args.contains("--stubborn"));
+        plugin->reportProgress(QString("ready"));
+        app.exec();
+        delete plugin;
+        return 0;
     }
 
     plugin->quit();
     delete plugin;
 }
 
+#include "testplugin.moc"
+
@@ -6,10 +6,14 @@ TEMPLATE = app
 
 CONFIG += \
     qt
+# to speak the channel protocol directly, and send broken results
 SOURCES += \
-    testplugin.cpp
+    testplugin.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-channel.cpp
+HEADERS += \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-channel.h
 
-QT += core xml
+QT += core network xml
 
 LIBS += -lAccountSetup
 DEPENDPATH += $${INCLUDEPATH}
@@ -1,2 +1,2 @@
 TEMPLATE = subdirs
-SUBDIRS = testclient.pro testplugin.pro
+SUBDIRS = testclient.pro testplugin.pro testinprocessplugin.pro benchmark.pro
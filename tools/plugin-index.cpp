@@ -0,0 +1,106 @@
+/*
+ * This file is part of libAccountSetup
+ *
+ * Copyright (C) 2011 Nokia Corporation.
+ *
+ * Contact: Alberto Mardegan <alberto.mardegan@nokia.com>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License
+ * version 2.1 as published by the Free Software Foundation.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA
+ * 02110-1301 USA
+ */
+
+
+/*
+ * Builds the plugin index used by ProviderPluginProxy to map providers to
+ * plugin executables without scanning the plugin directories. To be run
+ * whenever provider files or plugins are installed or removed: the library
+ * only notices that the index is out of date and falls back to scanning,
+ * it never rebuilds it. Packages installing plugins or provider files
+ * should run "accountsetup-plugin-index --check" after doing so.
+ */
+
+#include "AccountSetup/plugin-index.h"
+
+#include <Accounts/Manager>
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QStringList>
+
+#include <stdio.h>
+
+using namespace Accounts;
+using namespace AccountSetup;
+
+static void usage()
+{
+    fprintf(stderr,
+            "Usage: accountsetup-plugin-index [--check] [--output FILE] "
+            "[PLUGIN_DIR...]\n"
+            "  --check   rebuild the index only if it's out of date\n");
+}
+
+int main(int argc, char **argv)
+{
+    QCoreApplication app(argc, argv);
+
+    QString fileName = PluginIndex::defaultFileName();
+    QStringList pluginDirs;
+    bool check = false;
+
+    QStringList args = QCoreApplication::arguments();
+    for (int i = 1; i < args.length(); ++i)
+    {
+        if (args[i] == QLatin1String("--check"))
+        {
+            check = true;
+        }
+        else if (args[i] == QLatin1String("--output"))
+        {
+            i++;
+            if (i >= args.length()) {
+                usage();
+                return 1;
+            }
+            fileName = args[i];
+        }
+        else if (args[i].startsWith(QLatin1Char('-')))
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            pluginDirs << args[i];
+        }
+    }
+
+    if (pluginDirs.isEmpty())
+        pluginDirs << QString::fromLatin1("/usr/lib/AccountSetup");
+
+    if (check) {
+        PluginIndex index;
+        if (index.open(fileName) && !index.isStale() &&
+            index.pluginDirectories() == pluginDirs &&
+            index.providerDirectories() ==
+            PluginResolver::providerDirectories())
+            return 0;
+    }
+
+    Manager manager;
+    if (!PluginIndex::build(fileName, &manager, pluginDirs))
+        return 1;
+
+    return 0;
+}
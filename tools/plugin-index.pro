@@ -0,0 +1,26 @@
+include(../common-project-config.pri)
+include($${TOP_SRC_DIR}/common-vars.pri)
+
+TARGET = accountsetup-plugin-index
+TEMPLATE = app
+
+CONFIG += \
+    qt
+QT -= gui
+QT += xml
+
+# the index is private to the library, so the tool builds its own copy
+SOURCES += \
+    plugin-index.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-index.cpp \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-resolver.cpp
+HEADERS += \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-index.h \
+    $${TOP_SRC_DIR}/AccountSetup/plugin-resolver.h
+
+DEPENDPATH += $${INCLUDEPATH}
+PKGCONFIG += \
+    accounts-qt
+include($${TOP_SRC_DIR}/AccountSetup/libaccounts-glib.pri)
+
+include($${TOP_SRC_DIR}/common-installs-config.pri)